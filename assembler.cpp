@@ -0,0 +1,1152 @@
+#include "assembler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+#define ASM_LINE_SZ 256 // max length of a statement without its comment
+
+enum
+{
+    KIND_NONE,  // empty or label only
+    KIND_INSTR, // instruction
+    KIND_EQU,   // name = expression
+    KIND_ORG,   // .org
+    KIND_BYTE,  // .byte
+    KIND_WORD,  // .word
+    KIND_RES,   // .res
+};
+
+enum
+{
+    SYN_NONE,   // no operand
+    SYN_ACC,    // A
+    SYN_IMM,    // #expr
+    SYN_DIRECT, // expr
+    SYN_X,      // expr,X
+    SYN_Y,      // expr,Y
+    SYN_IND,    // (expr)
+    SYN_INDX,   // (expr,X)
+    SYN_INDY,   // (expr),Y
+};
+
+static const struct
+{
+    const char *name;
+    uint8_t kind;
+} directives[] = {
+    {"org", KIND_ORG},
+    {"byte", KIND_BYTE},
+    {"db", KIND_BYTE},
+    {"word", KIND_WORD},
+    {"dw", KIND_WORD},
+    {"res", KIND_RES},
+    {"ds", KIND_RES},
+    {"equ", KIND_EQU},
+    {"set", KIND_EQU},
+};
+
+typedef struct
+{
+    const asm_t *as;
+    const char *p;                 // next character
+    word pc;                       // value of '*'
+    bool undefined;                // a symbol has no value yet
+    char undef_name[ASM_SYM_LEN];  // first such symbol
+    const char *err;               // first error, or NULL
+} asm_expr_t;
+
+static uint64_t touched[MAX_MEM_SZ / 64]; // addresses cleared or emitted by the current assembly
+
+// FNV-1a
+static uint32_t AsmHash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (byte)s[i]) * 16777619u;
+    return h;
+}
+
+static void AsmError(asm_t *as, unsigned line, const char *fmt, ...)
+{
+    if (as->nerrors < ASM_MAX_ERRORS)
+    {
+        asm_error_t *err = &as->errors[as->nerrors];
+        err->line = line;
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(err->msg, sizeof(err->msg), fmt, ap);
+        va_end(ap);
+    }
+    as->nerrors++;
+}
+
+static int AsmCompareErrors(const void *a, const void *b)
+{
+    unsigned la = ((const asm_error_t *)a)->line, lb = ((const asm_error_t *)b)->line;
+    return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+static inline bool AsmIdentStart(int c)
+{
+    return isalpha(c) || c == '_';
+}
+
+static inline bool AsmIdentChar(int c)
+{
+    return isalnum(c) || c == '_';
+}
+
+// Slot of the symbol name[0, len) in a table of cap slots, or the empty slot
+// to add it in.
+static asm_sym_t *AsmSlotIn(asm_sym_t *syms, unsigned cap, const char *name, size_t len)
+{
+    unsigned msk = cap - 1;
+    for (unsigned i = AsmHash(name, len) & msk;; i = (i + 1) & msk)
+    {
+        asm_sym_t *sym = &syms[i];
+        if (!sym->name[0] || (strncmp(sym->name, name, len) == 0 && sym->name[len] == '\0'))
+            return sym;
+    }
+}
+
+static asm_sym_t *AsmSlot(const asm_t *as, const char *name, size_t len)
+{
+    return AsmSlotIn(as->syms, as->symcap, name, len);
+}
+
+bool AsmSymbol(const asm_t *as, const char *name, long *value)
+{
+    size_t len = strlen(name);
+    if (as->symcap == 0 || len == 0 || len >= ASM_SYM_LEN)
+        return false;
+    const asm_sym_t *sym = AsmSlot(as, name, len);
+    if (!sym->name[0] || !sym->defined)
+        return false;
+    *value = sym->value;
+    return true;
+}
+
+static long AsmBinary(asm_expr_t *e, int level);
+
+static void AsmSkipSpace(asm_expr_t *e)
+{
+    while (isspace((byte)*e->p))
+        e->p++;
+}
+
+static long AsmUnary(asm_expr_t *e)
+{
+    AsmSkipSpace(e);
+    const char *p = e->p;
+    long v = 0;
+    switch (*p)
+    {
+    case '-':
+        e->p++;
+        return -AsmUnary(e);
+    case '~':
+        e->p++;
+        return ~AsmUnary(e);
+    case '<':
+        e->p++;
+        return AsmUnary(e) & 0xff;
+    case '>':
+        e->p++;
+        return (AsmUnary(e) >> 8) & 0xff;
+    case '(':
+        e->p++;
+        v = AsmBinary(e, 0);
+        AsmSkipSpace(e);
+        if (*e->p != ')')
+        {
+            if (!e->err)
+                e->err = "missing ')'";
+            return 0;
+        }
+        e->p++;
+        return v;
+    case '*':
+        e->p++;
+        return e->pc;
+    case '\'':
+        if (!p[1])
+            break;
+        e->p = p[2] == '\'' ? p + 3 : p + 2;
+        return (byte)p[1];
+    case '$':
+    case '%':
+    {
+        int base = *p == '$' ? 16 : 2;
+        char *end;
+        v = strtol(p + 1, &end, base);
+        if (end == p + 1)
+            break;
+        e->p = end;
+        return v;
+    }
+    default:
+        break;
+    }
+    if (isdigit((byte)*p))
+    {
+        char *end;
+        v = (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) ? strtol(p + 2, &end, 16) : strtol(p, &end, 10);
+        e->p = end;
+        return v;
+    }
+    if (AsmIdentStart((byte)*p))
+    {
+        while (AsmIdentChar((byte)*e->p))
+            e->p++;
+        size_t len = e->p - p;
+        const asm_sym_t *sym = len < ASM_SYM_LEN ? AsmSlot(e->as, p, len) : NULL;
+        if (sym != NULL && sym->name[0] && sym->defined)
+            return sym->value;
+        if (!e->undefined)
+        {
+            snprintf(e->undef_name, sizeof(e->undef_name), "%.*s", (int)len, p);
+            e->undefined = true;
+        }
+        return 0;
+    }
+    if (!e->err)
+        e->err = "expected a value";
+    return 0;
+}
+
+// Binary operator at p, returns its precedence level or -1.
+static int AsmOperator(const char *p, char *op, int *len)
+{
+    *len = 1;
+    *op = *p;
+    switch (*p)
+    {
+    case '|':
+        return 0;
+    case '^':
+        return 1;
+    case '&':
+        return 2;
+    case '<':
+    case '>':
+        if (p[1] != p[0])
+            return -1;
+        *len = 2;
+        return 3;
+    case '+':
+    case '-':
+        return 4;
+    case '*':
+    case '/':
+    case '%':
+        return 5;
+    default:
+        return -1;
+    }
+}
+
+static long AsmBinary(asm_expr_t *e, int level)
+{
+    if (level > 5)
+        return AsmUnary(e);
+    long v = AsmBinary(e, level + 1);
+    for (;;)
+    {
+        AsmSkipSpace(e);
+        char op;
+        int len;
+        if (AsmOperator(e->p, &op, &len) != level)
+            return v;
+        e->p += len;
+        long r = AsmBinary(e, level + 1);
+        switch (op)
+        {
+        case '|':
+            v |= r;
+            break;
+        case '^':
+            v ^= r;
+            break;
+        case '&':
+            v &= r;
+            break;
+        case '<':
+            v <<= r;
+            break;
+        case '>':
+            v >>= r;
+            break;
+        case '+':
+            v += r;
+            break;
+        case '-':
+            v -= r;
+            break;
+        case '*':
+            v *= r;
+            break;
+        case '/':
+        case '%':
+            if (r == 0)
+            {
+                if (!e->err && !e->undefined)
+                    e->err = "division by zero";
+                break;
+            }
+            v = op == '/' ? v / r : v % r;
+            break;
+        }
+    }
+}
+
+// Evaluate the expression s at address pc. Returns an error or NULL.
+static const char *AsmEval(const asm_t *as, const char *s, word pc, long *val, asm_expr_t *e)
+{
+    memset(e, 0, sizeof(asm_expr_t));
+    e->as = as;
+    e->p = s;
+    e->pc = pc;
+    *val = AsmBinary(e, 0);
+    AsmSkipSpace(e);
+    if (!e->err && *e->p)
+        e->err = "unexpected text in expression";
+    return e->err;
+}
+
+// Copy the next comma separated item of the list at p to item, trimmed.
+// Returns the rest of the list, or NULL after the last item.
+static const char *AsmNextItem(const char *p, char *item, size_t sz)
+{
+    while (isspace((byte)*p))
+        p++;
+    const char *start = p;
+    int depth = 0;
+    char quote = 0;
+    for (; *p; p++)
+    {
+        if (quote)
+        {
+            if (*p == quote)
+                quote = 0;
+        }
+        else if (*p == '"')
+            quote = '"';
+        else if (*p == '\'' && p[1]) // character constant, skip the character
+            p += p[2] == '\'' ? 2 : 1;
+        else if (*p == '(')
+            depth++;
+        else if (*p == ')')
+            depth--;
+        else if (*p == ',' && depth <= 0)
+            break;
+    }
+    size_t len = p - start;
+    while (len > 0 && isspace((byte)start[len - 1]))
+        len--;
+    if (len >= sz)
+        len = sz - 1;
+    memcpy(item, start, len);
+    item[len] = '\0';
+    return *p ? p + 1 : NULL;
+}
+
+// Length of a "string" item without its quotes, or -1 if item is not a string.
+static int AsmString(const char *item)
+{
+    size_t len = strlen(item);
+    if (len < 2 || item[0] != '"' || item[len - 1] != '"')
+        return -1;
+    return len - 2;
+}
+
+static bool AsmMnemonic(const char *s, size_t len, int16_t *opcodes)
+{
+    if (len != 3)
+        return false;
+    bool found = false;
+    for (int m = 0; m < AM_COUNT; m++)
+        opcodes[m] = -1;
+    for (int op = 0; op < 256; op++)
+    {
+        const opcode_info_t *info = &OPCODE_INFO[op];
+        if ((info->access & OP_ILLEGAL) || opcodes[info->mode] >= 0)
+            continue;
+        if (toupper((byte)s[0]) == info->name[0] && toupper((byte)s[1]) == info->name[1] && toupper((byte)s[2]) == info->name[2])
+        {
+            opcodes[info->mode] = op;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static int AsmDirective(const char *s, size_t len)
+{
+    for (size_t i = 0; i < sizeof(directives) / sizeof(directives[0]); i++)
+        if (strlen(directives[i].name) == len && strncasecmp(directives[i].name, s, len) == 0)
+            return directives[i].kind;
+    return -1;
+}
+
+static char *AsmDup(const char *s, size_t len)
+{
+    char *d = (char *)malloc(len + 1);
+    if (d != NULL)
+    {
+        memcpy(d, s, len);
+        d[len] = '\0';
+    }
+    return d;
+}
+
+// Strip the ",X" or ",Y" after the operand expr[0, *len), returns the register or 0.
+static char AsmIndexReg(const char *expr, size_t *len)
+{
+    size_t n = *len;
+    if (n < 2 || (toupper((byte)expr[n - 1]) != 'X' && toupper((byte)expr[n - 1]) != 'Y'))
+        return 0;
+    size_t i = n - 1;
+    while (i > 0 && isspace((byte)expr[i - 1]))
+        i--;
+    if (i == 0 || expr[i - 1] != ',')
+        return 0;
+    i--;
+    while (i > 0 && isspace((byte)expr[i - 1]))
+        i--;
+    *len = i;
+    return toupper((byte)expr[n - 1]);
+}
+
+// Split the operand of an instruction into its syntax and expression.
+static const char *AsmOperand(asm_line_t *ln, const char *arg)
+{
+    size_t len = strlen(arg);
+    const char *expr = arg;
+    ln->syntax = SYN_DIRECT;
+    if (len == 0)
+    {
+        ln->syntax = SYN_NONE;
+        return NULL;
+    }
+    if (len == 1 && toupper((byte)arg[0]) == 'A')
+    {
+        ln->syntax = SYN_ACC;
+        return NULL;
+    }
+    if (arg[0] == '#')
+    {
+        ln->syntax = SYN_IMM;
+        expr++;
+        len--;
+    }
+    else if (arg[0] == '(')
+    {
+        // indirect if the parenthesis closing the first one ends the operand or is followed by ,Y
+        int depth = 0;
+        size_t close = 0;
+        for (size_t i = 0; i < len && !close; i++)
+        {
+            if (arg[i] == '(')
+                depth++;
+            else if (arg[i] == ')' && --depth == 0)
+                close = i;
+            else if (arg[i] == '\'' && i + 1 < len)
+                i += i + 2 < len && arg[i + 2] == '\'' ? 2 : 1;
+        }
+        size_t rest = len;
+        char reg = close ? AsmIndexReg(arg, &rest) : 0;
+        if (close && close == len - 1)
+        {
+            expr = arg + 1;
+            len = close - 1;
+            char inner = AsmIndexReg(expr, &len);
+            if (inner == 'Y')
+                return "(zp,Y) is not a 6502 addressing mode";
+            ln->syntax = inner == 'X' ? SYN_INDX : SYN_IND;
+        }
+        else if (close && reg == 'Y' && rest == close + 1)
+        {
+            expr = arg + 1;
+            len = close - 1;
+            ln->syntax = SYN_INDY;
+        }
+    }
+    if (ln->syntax == SYN_DIRECT)
+    {
+        char reg = AsmIndexReg(expr, &len);
+        if (reg)
+            ln->syntax = reg == 'X' ? SYN_X : SYN_Y;
+    }
+    while (len > 0 && isspace((byte)*expr))
+    {
+        expr++;
+        len--;
+    }
+    if (len == 0)
+        return "missing operand";
+    ln->arg = AsmDup(expr, len);
+    return ln->arg == NULL ? "out of memory" : NULL;
+}
+
+// Parse ln->text. Returns an error or NULL.
+static const char *AsmParse(asm_line_t *ln)
+{
+    ln->kind = KIND_NONE;
+    ln->syntax = SYN_NONE;
+    ln->label[0] = '\0';
+    ln->arg = NULL;
+    // copy the statement without its comment
+    char buf[ASM_LINE_SZ];
+    size_t n = 0;
+    char quote = 0;
+    const char *s;
+    for (s = ln->text; *s && n < sizeof(buf) - 1; s++)
+    {
+        if (quote)
+        {
+            if (*s == quote)
+                quote = 0;
+        }
+        else if (*s == ';')
+            break;
+        else if (*s == '"')
+            quote = '"';
+        buf[n++] = *s;
+    }
+    if (n == sizeof(buf) - 1 && *s && *s != ';')
+        return "line too long";
+    while (n > 0 && isspace((byte)buf[n - 1]))
+        n--;
+    buf[n] = '\0';
+    const char *p = buf;
+    bool col0 = !isspace((byte)*p);
+    while (isspace((byte)*p))
+        p++;
+    if (!*p)
+        return NULL;
+    bool dot = false;
+    int16_t opcodes[AM_COUNT];
+    // label or name of a constant
+    if (AsmIdentStart((byte)*p))
+    {
+        const char *id = p;
+        while (AsmIdentChar((byte)*p))
+            p++;
+        size_t len = p - id;
+        const char *q = p;
+        while (isspace((byte)*q))
+            q++;
+        const char *w = q + (*q == '.');
+        size_t wlen = 0;
+        while (AsmIdentChar((byte)w[wlen]))
+            wlen++;
+        bool label = *q == ':' || *q == '=' || AsmDirective(w, wlen) == KIND_EQU;
+        if (!label && col0)
+            label = !AsmMnemonic(id, len, opcodes) && AsmDirective(id, len) < 0;
+        if (label)
+        {
+            if (len >= ASM_SYM_LEN)
+                return "symbol too long";
+            memcpy(ln->label, id, len);
+            ln->label[len] = '\0';
+            p = *q == ':' ? q + 1 : q;
+        }
+        else
+            p = id;
+        while (isspace((byte)*p))
+            p++;
+    }
+    if (!*p)
+        return NULL;
+    // statement
+    const char *arg;
+    if (p[0] == '=' || (p[0] == '*' && p[1] == '='))
+    {
+        ln->kind = p[0] == '=' ? KIND_EQU : KIND_ORG;
+        arg = p + (p[0] == '=' ? 1 : 2);
+    }
+    else
+    {
+        if (*p == '.')
+        {
+            dot = true;
+            p++;
+        }
+        const char *w = p;
+        while (AsmIdentChar((byte)*p))
+            p++;
+        int kind = AsmDirective(w, p - w);
+        if (kind >= 0)
+            ln->kind = kind;
+        else if (dot)
+            return "unknown directive";
+        else if (AsmMnemonic(w, p - w, ln->opcodes))
+            ln->kind = KIND_INSTR;
+        else
+            return "unknown instruction";
+        if (*p && !isspace((byte)*p))
+            return "unexpected character after instruction";
+        arg = p;
+    }
+    while (isspace((byte)*arg))
+        arg++;
+    if (ln->kind == KIND_EQU && !ln->label[0])
+        return "constant without a name";
+    if (ln->kind == KIND_INSTR)
+        return AsmOperand(ln, arg);
+    if (!*arg)
+        return "missing operand";
+    ln->arg = AsmDup(arg, strlen(arg));
+    return ln->arg == NULL ? "out of memory" : NULL;
+}
+
+static int AsmPick(const int16_t *ops, bool zp, int zp_mode, int abs_mode)
+{
+    if (ops[zp_mode] >= 0 && (zp || ops[abs_mode] < 0))
+        return zp_mode;
+    return ops[abs_mode] >= 0 ? abs_mode : -1;
+}
+
+// Addressing mode of an instruction, or -1 if the mnemonic does not support its operand.
+static int AsmMode(const asm_line_t *ln)
+{
+    const int16_t *ops = ln->opcodes;
+    int mode = -1;
+    switch (ln->syntax)
+    {
+    case SYN_NONE:
+        mode = ops[AM_IMP] >= 0 ? AM_IMP : AM_ACC;
+        break;
+    case SYN_ACC:
+        mode = AM_ACC;
+        break;
+    case SYN_IMM:
+        mode = AM_IMM;
+        break;
+    case SYN_DIRECT:
+        if (ops[AM_REL] >= 0)
+            return AM_REL;
+        return AsmPick(ops, ln->zp, AM_ZP, AM_ABS);
+    case SYN_X:
+        return AsmPick(ops, ln->zp, AM_ZPX, AM_ABSX);
+    case SYN_Y:
+        return AsmPick(ops, ln->zp, AM_ZPY, AM_ABSY);
+    case SYN_IND:
+        mode = AM_IND;
+        break;
+    case SYN_INDX:
+        mode = AM_INDX;
+        break;
+    case SYN_INDY:
+        mode = AM_INDY;
+        break;
+    }
+    return ops[mode] >= 0 ? mode : -1;
+}
+
+static const char *AsmName(const asm_line_t *ln)
+{
+    for (int m = 0; m < AM_COUNT; m++)
+        if (ln->opcodes[m] >= 0)
+            return OPCODE_INFO[ln->opcodes[m]].name;
+    return "";
+}
+
+static void AsmEmit(asm_t *as, unsigned addr, byte val)
+{
+    as->image[addr] = val;
+    as->used[addr >> 6] |= 1ULL << (addr & 63);
+    as->changed[addr >> 6] |= 1ULL << (addr & 63);
+    as->bytes++;
+}
+
+// Mark [addr, addr + len) as touched by this assembly.
+static void AsmTouch(unsigned addr, unsigned len)
+{
+    for (unsigned a = addr; a < addr + len && a < MAX_MEM_SZ; a++)
+        touched[a >> 6] |= 1ULL << (a & 63);
+}
+
+// Whether any address in [addr, addr + len) was touched by this assembly.
+static bool AsmTouched(unsigned addr, unsigned len)
+{
+    for (unsigned a = addr; a < addr + len && a < MAX_MEM_SZ; a++)
+        if ((touched[a >> 6] >> (a & 63)) & 1)
+            return true;
+    return false;
+}
+
+// Drop the bytes a line emitted at [addr, addr + len) before emitting again.
+static void AsmClear(asm_t *as, unsigned addr, unsigned len)
+{
+    for (unsigned a = addr; a < addr + len && a < MAX_MEM_SZ; a++)
+    {
+        uint64_t bit = 1ULL << (a & 63);
+        as->image[a] = 0;
+        as->used[a >> 6] &= ~bit;
+        as->changed[a >> 6] |= bit;
+        touched[a >> 6] |= bit;
+    }
+}
+
+// Whether the operand s names a symbol whose value changed.
+static bool AsmUsesChanged(const asm_t *as, const char *s)
+{
+    while (*s)
+    {
+        if (*s == '"' || *s == '\'') // string or character
+        {
+            const char *end = *s == '"' ? strchr(s + 1, '"') : (s[1] ? (s[2] == '\'' ? s + 2 : s + 1) : s);
+            if (end == NULL)
+                return false;
+            s = end + 1;
+        }
+        else if (*s == '$' || isdigit((byte)*s)) // number
+        {
+            s++;
+            while (isalnum((byte)*s))
+                s++;
+        }
+        else if (AsmIdentStart((byte)*s))
+        {
+            const char *id = s;
+            while (AsmIdentChar((byte)*s))
+                s++;
+            size_t len = s - id;
+            const asm_sym_t *sym = len < ASM_SYM_LEN ? AsmSlot(as, id, len) : NULL;
+            if (sym != NULL && sym->name[0] && sym->changed)
+                return true;
+        }
+        else
+            s++;
+    }
+    return false;
+}
+
+static void AsmDefine(asm_t *as, unsigned line, const char *name, long value, bool first)
+{
+    asm_sym_t *sym = AsmSlot(as, name, strlen(name));
+    if (!sym->name[0])
+    {
+        strcpy(sym->name, name);
+        as->nsyms++;
+    }
+    else if (first && sym->defined)
+    {
+        AsmError(as, line, "duplicate symbol %s", name);
+        return;
+    }
+    sym->value = value;
+    sym->defined = true;
+}
+
+// Evaluate an operand that must be defined, reporting errors. Returns false on error.
+static bool AsmValue(asm_t *as, unsigned line, const char *s, word pc, long *val)
+{
+    asm_expr_t e;
+    const char *err = AsmEval(as, s, pc, val, &e);
+    if (err)
+        AsmError(as, line, "%s", err);
+    else if (e.undefined)
+        AsmError(as, line, "undefined symbol %s", e.undef_name);
+    return !err && !e.undefined;
+}
+
+static bool AsmRange(asm_t *as, unsigned line, long val, long min, long max, const char *what)
+{
+    if (val >= min && val <= max)
+        return true;
+    AsmError(as, line, "%s out of range: %ld", what, val);
+    return false;
+}
+
+// Pass 1: assign addresses and define labels. Returns the size of the line.
+static unsigned AsmPass1(asm_t *as, asm_line_t *ln, unsigned line, unsigned *pc)
+{
+    char item[ASM_LINE_SZ];
+    asm_expr_t e;
+    long val;
+    unsigned size = 0;
+    if (ln->label[0] && ln->kind != KIND_EQU)
+        AsmDefine(as, line, ln->label, *pc, true);
+    switch (ln->kind)
+    {
+    case KIND_INSTR:
+    {
+        // zero page if the operand is already known to fit, forward references
+        // stay absolute so that the size does not change in pass 2
+        ln->zp = false;
+        if (ln->arg != NULL && !AsmEval(as, ln->arg, *pc, &val, &e) && !e.undefined)
+            ln->zp = val >= 0 && val <= 0xff;
+        int mode = AsmMode(ln);
+        if (mode < 0)
+        {
+            AsmError(as, line, "addressing mode not supported by %s", AsmName(ln));
+            return 0;
+        }
+        size = ADDR_MODE_LEN[mode];
+        break;
+    }
+    case KIND_EQU:
+        if (!AsmEval(as, ln->arg, *pc, &val, &e) && !e.undefined)
+            AsmDefine(as, line, ln->label, val, true);
+        break;
+    case KIND_ORG:
+        if (AsmValue(as, line, ln->arg, *pc, &val) && AsmRange(as, line, val, 0, 0xffff, "address"))
+            *pc = val;
+        break;
+    case KIND_BYTE:
+    case KIND_WORD:
+        for (const char *p = ln->arg; p != NULL;)
+        {
+            p = AsmNextItem(p, item, sizeof(item));
+            int len = ln->kind == KIND_BYTE ? AsmString(item) : -1;
+            size += len >= 0 ? len : (ln->kind == KIND_BYTE ? 1 : 2);
+        }
+        break;
+    case KIND_RES:
+        AsmNextItem(ln->arg, item, sizeof(item));
+        if (AsmValue(as, line, item, *pc, &val) && AsmRange(as, line, val, 0, MAX_MEM_SZ, "size"))
+            size = val;
+        break;
+    }
+    if (*pc + size > MAX_MEM_SZ)
+    {
+        AsmError(as, line, "address beyond $FFFF");
+        return 0;
+    }
+    return size;
+}
+
+// Pass 2: emit the bytes of the line at ln->addr.
+static void AsmPass2(asm_t *as, asm_line_t *ln, unsigned line)
+{
+    char item[ASM_LINE_SZ];
+    unsigned pc = ln->addr;
+    long val = 0;
+    switch (ln->kind)
+    {
+    case KIND_INSTR:
+    {
+        int mode = AsmMode(ln);
+        if (ln->arg != NULL && !AsmValue(as, line, ln->arg, pc, &val))
+            return;
+        switch (mode)
+        {
+        case AM_IMM:
+            if (!AsmRange(as, line, val, -128, 0xff, "value"))
+                return;
+            break;
+        case AM_ZP:
+        case AM_ZPX:
+        case AM_ZPY:
+        case AM_INDX:
+        case AM_INDY:
+            if (!AsmRange(as, line, val, 0, 0xff, "zero page address"))
+                return;
+            break;
+        case AM_REL:
+            val -= pc + 2;
+            if (!AsmRange(as, line, val, -128, 127, "branch"))
+                return;
+            break;
+        case AM_ABS:
+        case AM_ABSX:
+        case AM_ABSY:
+        case AM_IND:
+            if (!AsmRange(as, line, val, -0x8000, 0xffff, "address"))
+                return;
+            break;
+        default:
+            break;
+        }
+        AsmEmit(as, pc, ln->opcodes[mode]);
+        if (ADDR_MODE_LEN[mode] > 1)
+            AsmEmit(as, pc + 1, val);
+        if (ADDR_MODE_LEN[mode] > 2)
+            AsmEmit(as, pc + 2, val >> 8);
+        break;
+    }
+    case KIND_EQU:
+        if (AsmValue(as, line, ln->arg, pc, &val))
+            AsmDefine(as, line, ln->label, val, false);
+        break;
+    case KIND_BYTE:
+    case KIND_WORD:
+        for (const char *p = ln->arg; p != NULL;)
+        {
+            p = AsmNextItem(p, item, sizeof(item));
+            int len = ln->kind == KIND_BYTE ? AsmString(item) : -1;
+            for (int i = 0; i < len; i++)
+                AsmEmit(as, pc++, item[i + 1]);
+            if (len >= 0)
+                continue;
+            // emit a placeholder on error to keep the addresses of the items
+            if (!AsmValue(as, line, item, pc, &val) || !AsmRange(as, line, val, ln->kind == KIND_BYTE ? -128 : -0x8000, ln->kind == KIND_BYTE ? 0xff : 0xffff, "value"))
+                val = 0;
+            AsmEmit(as, pc++, val);
+            if (ln->kind == KIND_WORD)
+                AsmEmit(as, pc++, val >> 8);
+        }
+        break;
+    case KIND_RES:
+    {
+        const char *fill = AsmNextItem(ln->arg, item, sizeof(item));
+        if (fill == NULL) // reserve only
+            break;
+        AsmNextItem(fill, item, sizeof(item));
+        if (!AsmValue(as, line, item, pc, &val) || !AsmRange(as, line, val, -128, 0xff, "value"))
+            break;
+        for (unsigned i = 0; i < ln->size; i++)
+            AsmEmit(as, pc + i, val);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void AsmFreeLines(asm_t *as)
+{
+    for (unsigned i = 0; i < as->nlines; i++)
+    {
+        free(as->lines[i].text);
+        free(as->lines[i].arg);
+    }
+    free(as->lines);
+    as->lines = NULL;
+    as->nlines = 0;
+}
+
+// Split src into lines, reusing the parse of the lines of the last assembly
+// with the same text.
+static bool AsmLines(asm_t *as, const char *src)
+{
+    unsigned n = 1;
+    for (const char *p = src; *p; p++)
+        n += *p == '\n';
+    asm_line_t *lines = (asm_line_t *)calloc(n, sizeof(asm_line_t));
+    unsigned idx_sz = 16;
+    while (idx_sz < 2 * as->nlines)
+        idx_sz *= 2;
+    int *idx = (int *)malloc(idx_sz * sizeof(int));
+    if (lines == NULL || idx == NULL)
+    {
+        perror("AsmAssemble: malloc: ");
+        free(lines);
+        free(idx);
+        return false;
+    }
+    // index the old lines by the hash of their text
+    for (unsigned i = 0; i < idx_sz; i++)
+        idx[i] = -1;
+    for (unsigned i = 0; i < as->nlines; i++)
+    {
+        unsigned k = as->lines[i].hash & (idx_sz - 1);
+        while (idx[k] >= 0)
+            k = (k + 1) & (idx_sz - 1);
+        idx[k] = i;
+    }
+    as->parsed = 0;
+    const char *p = src;
+    for (unsigned i = 0; i < n; i++)
+    {
+        const char *end = strchr(p, '\n');
+        if (end == NULL)
+            end = p + strlen(p);
+        size_t len = end - p;
+        if (len > 0 && p[len - 1] == '\r')
+            len--;
+        asm_line_t *ln = &lines[i];
+        uint32_t hash = AsmHash(p, len);
+        for (unsigned k = hash & (idx_sz - 1); idx[k] >= 0; k = (k + 1) & (idx_sz - 1))
+        {
+            asm_line_t *old = &as->lines[idx[k]];
+            if (old->text != NULL && old->hash == hash && strncmp(old->text, p, len) == 0 && old->text[len] == '\0')
+            {
+                *ln = *old;
+                old->text = NULL; // moved
+                old->arg = NULL;
+                break;
+            }
+        }
+        if (ln->text == NULL)
+        {
+            ln->hash = hash;
+            ln->text = AsmDup(p, len);
+            ln->err = ln->text == NULL ? "out of memory" : AsmParse(ln);
+            as->parsed++;
+        }
+        p = *end ? end + 1 : end;
+    }
+    free(idx);
+    // the bytes of the lines that are gone
+    for (unsigned i = 0; i < as->nlines; i++)
+        if (as->lines[i].text != NULL && as->lines[i].nbytes)
+            AsmClear(as, as->lines[i].addr, as->lines[i].nbytes);
+    AsmFreeLines(as);
+    as->lines = lines;
+    as->nlines = n;
+    return true;
+}
+
+bool AsmAssemble(asm_t *as, const char *src)
+{
+    as->nerrors = 0;
+    memset(touched, 0, sizeof(touched));
+    if (!AsmLines(as, src))
+    {
+        AsmError(as, 0, "out of memory");
+        return false;
+    }
+    // a new symbol table with room for all names, also those of the last
+    // assembly, at most half full
+    unsigned nnames = as->nsyms;
+    for (unsigned i = 0; i < as->nlines; i++)
+        nnames += as->lines[i].label[0] != '\0';
+    unsigned cap = 16;
+    while (cap < 2 * nnames)
+        cap *= 2;
+    asm_sym_t *prev = as->syms;
+    unsigned prevcap = as->symcap;
+    as->syms = (asm_sym_t *)calloc(cap, sizeof(asm_sym_t));
+    if (as->syms == NULL)
+    {
+        perror("AsmAssemble: malloc: ");
+        as->syms = prev;
+        AsmError(as, 0, "out of memory");
+        return false;
+    }
+    as->symcap = cap;
+    as->nsyms = 0;
+    // pass 1 for all lines, the ones that moved, changed size or failed emit again
+    unsigned pc = ASM_DEFAULT_ORG;
+    for (unsigned i = 0; i < as->nlines; i++)
+    {
+        asm_line_t *ln = &as->lines[i];
+        word old_addr = ln->addr;
+        unsigned old_size = ln->size;
+        bool dirty = !ln->placed || ln->failed2;
+        ln->size = 0;
+        ln->failed = true;
+        ln->failed2 = false;
+        ln->dirty = false;
+        if (ln->err)
+        {
+            ln->placed = false;
+            AsmError(as, i + 1, "%s", ln->err);
+            continue;
+        }
+        unsigned nerrors = as->nerrors;
+        unsigned size = AsmPass1(as, ln, i + 1, &pc);
+        ln->addr = pc;
+        ln->size = size;
+        ln->failed = as->nerrors != nerrors;
+        ln->dirty = dirty || ln->failed || ln->addr != old_addr || ln->size != old_size;
+        if (ln->failed)
+            ln->placed = false;
+        if (ln->dirty && ln->nbytes)
+        {
+            AsmClear(as, old_addr, ln->nbytes);
+            ln->nbytes = 0;
+        }
+        pc += size;
+    }
+    // symbols that changed, and the ones that are gone
+    unsigned changed = 0;
+    for (unsigned i = 0; i < as->symcap; i++)
+    {
+        asm_sym_t *sym = &as->syms[i];
+        if (!sym->name[0])
+            continue;
+        const asm_sym_t *old = prev != NULL ? AsmSlotIn(prev, prevcap, sym->name, strlen(sym->name)) : NULL;
+        sym->changed = old == NULL || !old->name[0] || old->defined != sym->defined || old->value != sym->value;
+        changed += sym->changed;
+    }
+    for (unsigned i = 0; i < prevcap; i++)
+    {
+        const asm_sym_t *old = &prev[i];
+        if (!old->name[0] || !old->defined)
+            continue;
+        asm_sym_t *sym = AsmSlot(as, old->name, strlen(old->name));
+        if (sym->name[0])
+            continue;
+        strcpy(sym->name, old->name); // undefined from now on
+        sym->changed = true;
+        changed++;
+    }
+    free(prev);
+    // lines using them emit again
+    for (unsigned i = 0; i < as->nlines && changed; i++)
+    {
+        asm_line_t *ln = &as->lines[i];
+        if (ln->dirty || ln->failed || ln->arg == NULL || !AsmUsesChanged(as, ln->arg))
+            continue;
+        ln->dirty = true;
+        if (ln->nbytes)
+        {
+            AsmClear(as, ln->addr, ln->nbytes);
+            ln->nbytes = 0;
+        }
+    }
+    // so do the lines whose bytes overlap those of an emitting line
+    for (unsigned i = 0; i < as->nlines; i++)
+        if (as->lines[i].dirty && !as->lines[i].failed)
+            AsmTouch(as->lines[i].addr, as->lines[i].size);
+    for (bool more = true; more;)
+    {
+        more = false;
+        for (unsigned i = 0; i < as->nlines; i++)
+        {
+            asm_line_t *ln = &as->lines[i];
+            if (ln->dirty || !ln->nbytes || !AsmTouched(ln->addr, ln->nbytes))
+                continue;
+            ln->dirty = true;
+            AsmClear(as, ln->addr, ln->nbytes);
+            ln->nbytes = 0;
+            more = true;
+        }
+    }
+    // pass 2, addresses are final, the lines that failed in pass 1 would only
+    // repeat their errors, constants are defined again for forward references
+    as->emitted = 0;
+    for (unsigned i = 0; i < as->nlines; i++)
+    {
+        asm_line_t *ln = &as->lines[i];
+        if (ln->failed || (!ln->dirty && ln->kind != KIND_EQU))
+            continue;
+        unsigned nerrors = as->nerrors, bytes = as->bytes;
+        AsmPass2(as, ln, i + 1);
+        ln->failed2 = as->nerrors != nerrors;
+        ln->placed = true;
+        ln->nbytes = as->bytes - bytes;
+        as->emitted += ln->dirty;
+    }
+    as->bytes = 0;
+    as->start = -1;
+    for (unsigned i = 0; i < as->nlines; i++)
+    {
+        const asm_line_t *ln = &as->lines[i];
+        if (ln->nbytes && as->start < 0)
+            as->start = ln->addr;
+        as->bytes += ln->nbytes;
+    }
+    // list the errors of both passes in source order
+    qsort(as->errors, as->nerrors < ASM_MAX_ERRORS ? as->nerrors : ASM_MAX_ERRORS, sizeof(asm_error_t), AsmCompareErrors);
+    return as->nerrors == 0;
+}
+
+void AsmFree(asm_t *as)
+{
+    for (unsigned i = 0; i < as->nlines; i++)
+        if (as->lines[i].nbytes)
+            AsmClear(as, as->lines[i].addr, as->lines[i].nbytes);
+    AsmFreeLines(as);
+    free(as->syms);
+    as->syms = NULL;
+    as->symcap = 0;
+    as->nsyms = 0;
+}
@@ -0,0 +1,99 @@
+// Two-pass 6502 assembler with labels, expressions and directives.
+//
+// Syntax, one statement per line, ';' starts a comment:
+//   label:  LDA #<table+1   ; label at the current address, ':' optional in column 0
+//   name = $10              ; constant, also "name equ $10"
+//           .org $8000      ; also "*= $8000", sets the current address
+//           .byte 1, "text" ; also .db, bytes and strings
+//           .word start     ; also .dw, little-endian words
+//           .res 16, $ff    ; also .ds, reserve bytes, filled with 0 or the given byte
+// Numbers are $hex, 0xhex, %binary, decimal or 'c'. Expressions use symbols,
+// '*' for the current address, unary - ~ < (low byte) > (high byte), and
+// * / % + - << >> & ^ | with C precedence. An operand in parentheses is
+// indirect: (zp,X), (zp),Y and JMP (abs).
+//
+// The parse of each source line is kept between assemblies and reused for
+// lines whose text did not change, wherever they moved, so that assembling
+// again after an edit only parses the edited lines. Addresses are assigned
+// to all lines again, but only the lines that are new, moved, changed size,
+// had errors, or use a symbol whose value changed emit their bytes again,
+// over the bytes they emitted before. The other bytes stay in the image.
+
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include <stdint.h>
+
+#define ASM_SYM_LEN 32          // max symbol length including the terminator
+#define ASM_MSG_LEN 80          // max error message length
+#define ASM_MAX_ERRORS 32       // errors kept per assembly
+#define ASM_DEFAULT_ORG 0x8000  // address before the first .org
+
+typedef struct
+{
+    unsigned line;         // source line, starting at 1
+    char msg[ASM_MSG_LEN];
+} asm_error_t;
+
+typedef struct
+{
+    char name[ASM_SYM_LEN]; // "" if the slot is empty
+    long value;
+    bool defined;           // defined in the current pass
+    bool changed;           // value differs from the last assembly
+} asm_sym_t;
+
+typedef struct
+{
+    char *text;                // malloc'd source text of the line
+    uint32_t hash;             // hash of text
+    uint8_t kind;              // statement kind, see assembler.cpp
+    uint8_t syntax;            // operand syntax of an instruction
+    bool zp;                   // pass 1 chose a zero page addressing mode
+    const char *err;           // parse error, or NULL
+    char label[ASM_SYM_LEN];   // label or constant defined on the line, or ""
+    int16_t opcodes[AM_COUNT]; // opcode of the mnemonic per addressing mode, -1 if none
+    char *arg;                 // malloc'd operand, NULL if none
+    word addr;                 // address of the line in the last assembly
+    unsigned size;             // bytes emitted by the line
+    bool failed;               // pass 1 reported an error on the line
+    bool failed2;              // pass 2 reported an error on the line
+    bool placed;               // pass 2 ran on the line in the last assembly
+    bool dirty;                // emit the line again in this assembly
+    unsigned nbytes;           // bytes the line put into the image from addr
+} asm_line_t;
+
+typedef struct
+{
+    asm_line_t *lines; // lines of the last assembly
+    unsigned nlines;
+    asm_sym_t *syms;   // symbol table, open addressing
+    unsigned symcap;   // slots in the table, power of 2
+    unsigned nsyms;
+    byte image[MAX_MEM_SZ];                // assembled bytes
+    uint64_t used[MAX_MEM_SZ / 64];        // addresses holding an assembled byte, one bit each
+    uint64_t changed[MAX_MEM_SZ / 64];     // addresses emitted or dropped since the bits were cleared
+    asm_error_t errors[ASM_MAX_ERRORS];
+    unsigned nerrors; // errors found, may be more than ASM_MAX_ERRORS
+    unsigned parsed;  // lines parsed by the last assembly, the others were reused
+    unsigned emitted; // lines emitted by the last assembly, the others kept their bytes
+    unsigned bytes;   // bytes assembled
+    int start;        // address of the first byte assembled, -1 if none
+} asm_t;
+
+// Assemble the NUL terminated source src into as->image. Returns false if
+// there are errors, listed in as->errors. as must be zeroed before first use.
+bool AsmAssemble(asm_t *as, const char *src);
+// Whether addr holds an assembled byte.
+static inline bool AsmUsed(const asm_t *as, word addr)
+{
+    return (as->used[addr >> 6] >> (addr & 63)) & 1;
+}
+// Value of a symbol after the last assembly. Returns false if it is not defined.
+bool AsmSymbol(const asm_t *as, const char *name, long *value);
+// Free the lines and symbols kept by as.
+void AsmFree(asm_t *as);
+
+#endif // ASSEMBLER_H
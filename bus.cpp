@@ -0,0 +1,181 @@
+#include "bus.h"
+#include "dirty.h"
+#include <stdio.h>
+#include <string.h>
+
+const char *const BUS_KIND_NAME[BUS_KIND_COUNT] = {"RAM", "ROM", "device"};
+
+bus_page_t bus_page[BUS_PAGES];
+volatile unsigned bus_mapped = 0;
+volatile unsigned bus_devices = 0;
+volatile uint8_t bus_access = 0;
+byte bus_rom[MAX_MEM_SZ];
+uint64_t bus_ro[MAX_MEM_SZ / 64];
+volatile bool bus_rom_trap = false;
+word bus_rom_addr = 0;
+
+op_access_t bus_pend = {0, 0, 0};
+
+// Count the mapped pages and the accesses they need.
+static void BusUpdate()
+{
+    unsigned count = 0, devices = 0;
+    uint8_t access = 0;
+    for (unsigned page = 0; page < BUS_PAGES; page++)
+    {
+        const bus_page_t *p = &bus_page[page];
+        if (p->kind == BUS_RAM)
+            continue;
+        count++;
+        access |= OP_WRITE;
+        if (p->kind != BUS_DEVICE)
+            continue;
+        devices++;
+        if (p->dev->read != NULL)
+            access |= OP_READ;
+    }
+    bus_pend.len = 0;
+    bus_mapped = count;
+    bus_devices = devices;
+    bus_access = access;
+}
+
+bool BusMap(const cpu_6502 *cpu, unsigned first, unsigned npages, bus_kind_t kind, const bus_device_t *dev)
+{
+    if (npages == 0 || first + npages > BUS_PAGES || kind >= BUS_KIND_COUNT)
+        return false;
+    if (kind == BUS_DEVICE && (dev == NULL || first < 2))
+    {
+        printf("BusMap: devices need a device and a page above the stack\n");
+        return false;
+    }
+    for (unsigned page = first; page < first + npages; page++)
+    {
+        bus_page[page].kind = kind;
+        bus_page[page].dev = kind == BUS_DEVICE ? dev : NULL;
+    }
+    // 4 words of the bitmap per page
+    memset(&bus_ro[first << 2], kind == BUS_ROM ? 0xff : 0, npages << 5);
+    if (kind == BUS_ROM)
+        memcpy(&bus_rom[first << 8], &cpu->mem[first << 8], npages << 8);
+    BusUpdate();
+    return true;
+}
+
+bool BusProtect(const cpu_6502 *cpu, word start, word end, bool ro)
+{
+    if (start > end)
+        return false;
+    for (unsigned page = start >> 8; page <= (unsigned)(end >> 8); page++)
+    {
+        if (bus_page[page].kind == BUS_DEVICE)
+        {
+            printf("BusProtect: page 0x%02X is a device\n", page);
+            return false;
+        }
+    }
+    for (unsigned addr = start; addr <= end; addr++)
+    {
+        if (ro)
+            bus_ro[addr >> 6] |= 1ULL << (addr & 63);
+        else
+            bus_ro[addr >> 6] &= ~(1ULL << (addr & 63));
+    }
+    if (ro)
+        memcpy(&bus_rom[start], &cpu->mem[start], end - start + 1);
+    for (unsigned page = start >> 8; page <= (unsigned)(end >> 8); page++)
+    {
+        const uint64_t *w = &bus_ro[page << 2];
+        bus_page[page].kind = (w[0] | w[1] | w[2] | w[3]) ? BUS_ROM : BUS_RAM;
+    }
+    BusUpdate();
+    return true;
+}
+
+unsigned BusRomNext(unsigned addr, unsigned *end)
+{
+    while (addr < MAX_MEM_SZ && !BusReadOnly(addr))
+    {
+        if (bus_page[addr >> 8].kind != BUS_ROM)
+            addr = (addr | 0xff) + 1; // skip the page
+        else
+            addr++;
+    }
+    if (addr >= MAX_MEM_SZ)
+        return MAX_MEM_SZ;
+    unsigned last = addr;
+    while (last + 1 < MAX_MEM_SZ && BusReadOnly(last + 1))
+        last++;
+    *end = last;
+    return addr;
+}
+
+void BusRomSync(const cpu_6502 *cpu, word addr, unsigned len)
+{
+    if (!bus_mapped)
+        return;
+    for (unsigned k = 0; k < len; k++)
+    {
+        word a = addr + k;
+        if (bus_page[a >> 8].kind == BUS_ROM)
+            bus_rom[a] = cpu->mem[a];
+    }
+}
+
+// Undo the ROM writes of the instruction that just executed, and pass on the
+// device writes.
+void BusFinish(cpu_6502 *cpu, bool devices)
+{
+    for (unsigned k = 0; k < bus_pend.len; k++)
+    {
+        word addr = op_access_addr(&bus_pend, k);
+        const bus_page_t *page = &bus_page[addr >> 8];
+        if (BusReadOnly(addr))
+            cpu->mem[addr] = bus_rom[addr];
+        else if (page->kind == BUS_DEVICE && devices && page->dev->write != NULL)
+            page->dev->write(page->dev->ctx, addr, cpu->mem[addr]);
+    }
+    bus_pend.len = 0;
+}
+
+// Fill in the device bytes the next instruction reads, and note what it writes.
+bool BusPrepare(cpu_6502 *cpu, const op_access_t *acc, bool devices)
+{
+    if ((acc->access & OP_READ) && devices)
+    {
+        // the core reads memory in a later cycle, have the device value there
+        for (unsigned k = 0; k < acc->len; k++)
+        {
+            word addr = op_access_addr(acc, k);
+            const bus_page_t *page = &bus_page[addr >> 8];
+            if (page->kind != BUS_DEVICE || page->dev->read == NULL)
+                continue;
+            byte val = page->dev->read(page->dev->ctx, addr);
+            if (cpu->mem[addr] != val)
+            {
+                cpu->mem[addr] = val;
+                DirtyMark(&mem_dirty, addr, 1);
+            }
+        }
+    }
+    if (!(acc->access & OP_WRITE))
+        return false;
+    bus_pend = *acc;
+    if (!bus_rom_trap || !devices)
+        return false;
+    for (unsigned k = 0; k < acc->len; k++)
+    {
+        word addr = op_access_addr(acc, k);
+        if (BusReadOnly(addr))
+        {
+            bus_rom_addr = addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BusReset()
+{
+    bus_pend.len = 0;
+}
@@ -0,0 +1,123 @@
+// Memory bus: a page table that maps each 256 byte page to plain RAM, to ROM
+// or to a device. The CPU core works on cpu->mem directly, so the bus works
+// on whole instructions: at each instruction boundary the data access of the
+// next instruction is decoded and device pages it reads are filled in from the
+// device first. While it executes, the bytes it wrote to ROM are put back after
+// every cycle, so no later cycle, trace entry or rewind journal sees them
+// changed. The bytes it wrote to device pages are handed to the device on the
+// first cycle of the next instruction, before it reads anything: a device sees
+// a write one cycle late, and not until the CPU continues if it is paused right
+// after the writing instruction. Memory is all RAM
+// until something is mapped, and then only instructions that access memory pay
+// for a page table lookup, only those that write if no device reads. ROM pages
+// can be read-only in part: a bitmap of the protected bytes is only looked at
+// for the writes that hit a ROM page.
+
+#ifndef BUS_H
+#define BUS_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include <stdint.h>
+
+#define BUS_PAGES (MAX_MEM_SZ >> 8) // 256 byte pages in the address space
+
+typedef enum
+{
+    BUS_RAM,    // plain memory
+    BUS_ROM,    // writes by the CPU to the protected bytes are dropped
+    BUS_DEVICE, // reads and writes go to a device
+    BUS_KIND_COUNT
+} bus_kind_t;
+
+extern const char *const BUS_KIND_NAME[BUS_KIND_COUNT];
+
+typedef struct
+{
+    const char *name;
+    // Value the CPU reads at addr, or NULL to read memory as it is.
+    byte (*read)(void *ctx, word addr);
+    // Value the CPU wrote to addr, it is in memory too. NULL to only store it.
+    void (*write)(void *ctx, word addr, byte val);
+    void *ctx;
+} bus_device_t;
+
+typedef struct
+{
+    uint8_t kind;            // bus_kind_t
+    const bus_device_t *dev; // device of BUS_DEVICE pages
+} bus_page_t;
+
+extern bus_page_t bus_page[BUS_PAGES];
+extern volatile unsigned bus_mapped;     // pages that are not RAM
+extern volatile unsigned bus_devices;    // pages mapped to a device
+extern volatile uint8_t bus_access;      // OP_READ, OP_WRITE: accesses BusAccess() needs, 0 if all RAM
+extern byte bus_rom[MAX_MEM_SZ];         // contents of the ROM pages
+extern uint64_t bus_ro[MAX_MEM_SZ / 64]; // protected bytes of the ROM pages, one bit per address
+extern volatile bool bus_rom_trap;       // stop before an instruction writes a protected byte
+extern word bus_rom_addr;                // protected byte the trapped instruction writes
+extern op_access_t bus_pend;             // write of the current instruction on pages that are not RAM, len 0 if none
+
+static inline bool BusSpecial(word addr)
+{
+    return bus_page[addr >> 8].kind != BUS_RAM;
+}
+
+static inline bool BusReadOnly(word addr)
+{
+    return bus_page[addr >> 8].kind == BUS_ROM && ((bus_ro[addr >> 6] >> (addr & 63)) & 1);
+}
+
+// Map npages pages from first as kind, dev is the device of BUS_DEVICE. ROM
+// pages are read-only as a whole and keep what memory holds. Devices can not go on the zero page or the
+// stack, which the core reads internally. Call on the CPU thread, returns
+// false on a bad range.
+bool BusMap(const cpu_6502 *cpu, unsigned first, unsigned npages, bus_kind_t kind, const bus_device_t *dev);
+// Make the bytes in [start, end] read-only, or writable again if ro is false.
+// Their pages turn into ROM pages, or back into RAM once no byte in them is
+// protected. Call on the CPU thread, returns false if the range is bad or
+// touches a device page.
+bool BusProtect(const cpu_6502 *cpu, word start, word end, bool ro);
+// First address of the next run of protected bytes at or after addr, with its
+// last address in *end, or MAX_MEM_SZ if there is none.
+unsigned BusRomNext(unsigned addr, unsigned *end);
+// Take the contents of the ROM pages in [addr, addr + len) from memory, after
+// a load or the debugger wrote there.
+void BusRomSync(const cpu_6502 *cpu, word addr, unsigned len);
+void BusFinish(cpu_6502 *cpu, bool devices);
+bool BusPrepare(cpu_6502 *cpu, const op_access_t *acc, bool devices);
+
+// Called on the first cycle of each instruction, when bus_access: finish the
+// accesses of the last instruction, before anything looks at the memory it
+// left.
+static inline void BusRetire(cpu_6502 *cpu, bool devices)
+{
+    if (bus_pend.len)
+        BusFinish(cpu, devices);
+}
+// Then prepare acc, the op_access() of the next one, NULL if it accesses no
+// data. Devices are not called if devices is false, when the state was
+// replaced from outside the CPU. Returns true if bus_rom_trap is set and the
+// next instruction writes a protected byte, never without devices.
+static inline bool BusAccess(cpu_6502 *cpu, const op_access_t *acc, bool devices)
+{
+    if (acc != NULL && (BusSpecial(acc->addr) || BusSpecial(op_access_addr(acc, acc->len - 1))))
+        return BusPrepare(cpu, acc, devices);
+    return false;
+}
+// Called after each cycle of an instruction but its first: put back the
+// protected bytes it wrote in that cycle, e.g. the result of INC on ROM, before
+// the next cycle can read them.
+static inline void BusUndoRom(cpu_6502 *cpu)
+{
+    for (unsigned k = 0; k < bus_pend.len; k++)
+    {
+        word addr = op_access_addr(&bus_pend, k);
+        if (BusReadOnly(addr))
+            cpu->mem[addr] = bus_rom[addr];
+    }
+}
+// Forget the accesses of the current instruction, after the state was replaced.
+void BusReset();
+
+#endif // BUS_H
@@ -0,0 +1,129 @@
+#include "delta.h"
+#include <string.h>
+
+static inline byte DeltaBase(const byte *base, size_t i)
+{
+    return base != NULL ? base[i] : 0;
+}
+
+// Bytes from i on equal to the base.
+static size_t DeltaSame(const byte *src, const byte *base, size_t i, size_t n)
+{
+    size_t j = i;
+    while (j < n && src[j] == DeltaBase(base, j))
+        j++;
+    return j - i;
+}
+
+// Bytes from i on equal to src[i].
+static size_t DeltaRun(const byte *src, size_t i, size_t n)
+{
+    size_t j = i + 1;
+    while (j < n && src[j] == src[i])
+        j++;
+    return j - i;
+}
+
+// Whether a SKIP or FILL token is worth starting at j.
+static bool DeltaBreak(const byte *src, const byte *base, size_t j, size_t n)
+{
+    size_t k = 0;
+    while (j + k < n && k < DELTA_MIN_SKIP && src[j + k] == DeltaBase(base, j + k))
+        k++;
+    if (k == DELTA_MIN_SKIP || (k > 0 && j + k == n))
+        return true;
+    k = 1;
+    while (j + k < n && k < DELTA_MIN_FILL && src[j + k] == src[j])
+        k++;
+    return k == DELTA_MIN_FILL;
+}
+
+static byte *DeltaToken(byte *out, size_t len, unsigned kind)
+{
+    size_t val = (len << 2) | kind;
+    while (val >= 0x80)
+    {
+        *out++ = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *out++ = val;
+    return out;
+}
+
+size_t DeltaEncode(const byte *src, const byte *base, size_t n, byte *out)
+{
+    byte *p = out;
+    size_t i = 0;
+    while (i < n)
+    {
+        size_t same = DeltaSame(src, base, i, n);
+        if (same >= DELTA_MIN_SKIP || i + same == n)
+        {
+            p = DeltaToken(p, same, DELTA_SKIP);
+            i += same;
+            continue;
+        }
+        size_t run = DeltaRun(src, i, n);
+        if (run >= DELTA_MIN_FILL)
+        {
+            p = DeltaToken(p, run, DELTA_FILL);
+            *p++ = src[i];
+            i += run;
+            continue;
+        }
+        // copy up to the next run worth its own token
+        size_t j = i + 1;
+        while (j < n && !DeltaBreak(src, base, j, n))
+            j++;
+        p = DeltaToken(p, j - i, DELTA_COPY);
+        memcpy(p, &src[i], j - i);
+        p += j - i;
+        i = j;
+    }
+    return p - out;
+}
+
+size_t DeltaDecode(const byte *in, size_t len, const byte *base, byte *dst, size_t n)
+{
+    size_t pos = 0, i = 0;
+    while (i < n)
+    {
+        size_t val = 0;
+        for (unsigned shift = 0;; shift += 7)
+        {
+            if (pos == len || shift > 28)
+                return 0;
+            byte b = in[pos++];
+            val |= (size_t)(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        size_t cnt = val >> 2;
+        if (cnt == 0 || cnt > n - i)
+            return 0;
+        switch (val & 3)
+        {
+        case DELTA_SKIP:
+            if (base != NULL)
+                memcpy(&dst[i], &base[i], cnt);
+            else
+                memset(&dst[i], 0, cnt);
+            break;
+        case DELTA_COPY:
+            if (cnt > len - pos)
+                return 0;
+            memcpy(&dst[i], &in[pos], cnt);
+            pos += cnt;
+            break;
+        case DELTA_FILL:
+            if (pos == len)
+                return 0;
+            memset(&dst[i], in[pos++], cnt);
+            break;
+        default:
+            return 0;
+        }
+        i += cnt;
+    }
+    return pos;
+}
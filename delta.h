@@ -0,0 +1,32 @@
+// Delta coding of a buffer against a base buffer, used by the compact save
+// states. The output is a sequence of tokens, each a LEB128 varint holding
+// len << 2 | kind:
+//   DELTA_SKIP  len bytes equal to the base
+//   DELTA_COPY  len bytes that follow
+//   DELTA_FILL  len copies of the byte that follows
+// The tokens always cover the whole buffer, so that encoded buffers can be
+// stored back to back without lengths.
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include <stddef.h>
+
+#define DELTA_SKIP 0
+#define DELTA_COPY 1
+#define DELTA_FILL 2
+
+#define DELTA_MIN_SKIP 3 // shorter equal runs are copied along with their neighbors
+#define DELTA_MIN_FILL 4 // shorter runs of one byte are copied
+
+#define DELTA_BOUND(n) ((n) + (n) / 2 + 16) // max encoded size of n bytes
+
+// Encode n bytes of src against base, or against zeros if base is NULL, into
+// out, which holds at least DELTA_BOUND(n) bytes. Returns the encoded size.
+size_t DeltaEncode(const byte *src, const byte *base, size_t n, byte *out);
+// Decode n bytes into dst from the len bytes at in, against base or zeros.
+// Returns the number of bytes of in used, or 0 if in is malformed.
+size_t DeltaDecode(const byte *in, size_t len, const byte *base, byte *dst, size_t n);
+
+#endif // DELTA_H
@@ -0,0 +1,24 @@
+#include "dirty.h"
+#include <string.h>
+
+dirty_t mem_dirty;
+
+unsigned DirtyTake(const dirty_t *d, uint64_t *since, uint64_t pages[DIRTY_WORDS])
+{
+    uint64_t gen = __atomic_load_n(&d->gen, __ATOMIC_ACQUIRE);
+    uint64_t last = *since;
+    unsigned count = 0;
+    memset(pages, 0, DIRTY_WORDS * sizeof(uint64_t));
+    if (gen != last)
+    {
+        for (unsigned page = 0; page < DIRTY_PAGES; page++)
+        {
+            if (__atomic_load_n(&d->page[page], __ATOMIC_RELAXED) <= last)
+                continue;
+            pages[page >> 6] |= 1ULL << (page & 63);
+            count++;
+        }
+    }
+    *since = gen;
+    return count;
+}
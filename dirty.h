@@ -0,0 +1,69 @@
+// Dirty page tracking: each change to a 256 byte page of the address space
+// stamps the page with a new generation. Readers that mirror memory keep the
+// generation they last looked at, and get a bitmap of the pages stamped since,
+// so that they only process those instead of all 64 KiB. mem_dirty tracks the
+// writes to cpu->mem, by the CPU at its instruction boundaries and by the GUI
+// and the loaders where the commands are applied. Only the CPU thread stamps.
+
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include <stdint.h>
+
+#define DIRTY_PAGES (MAX_MEM_SZ >> 8)  // 256 byte pages in the address space
+#define DIRTY_WORDS (DIRTY_PAGES / 64) // 64-bit words in a page bitmap
+
+typedef struct
+{
+    volatile uint64_t gen;      // latest generation
+    uint64_t page[DIRTY_PAGES]; // generation of the last change to each page
+} dirty_t;
+
+extern dirty_t mem_dirty; // writes to cpu->mem
+
+// Stamp the pages of [addr, addr + len), wrapping at the end of memory.
+static inline void DirtyMark(dirty_t *d, word addr, unsigned len)
+{
+    uint64_t gen = d->gen + 1;
+    if (len <= 0x100) // one or two pages, the CPU writes at most 3 bytes
+    {
+        __atomic_store_n(&d->page[addr >> 8], gen, __ATOMIC_RELAXED);
+        __atomic_store_n(&d->page[(word)(addr + len - 1) >> 8], gen, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        unsigned npages = ((addr & 0xff) + len + 0xff) >> 8;
+        if (npages > DIRTY_PAGES)
+            npages = DIRTY_PAGES;
+        for (unsigned k = 0, page = addr >> 8; k < npages; k++, page = (page + 1) & (DIRTY_PAGES - 1))
+            __atomic_store_n(&d->page[page], gen, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&d->gen, gen, __ATOMIC_RELEASE);
+}
+
+// Stamp every page, after memory was replaced as a whole.
+static inline void DirtyMarkAll(dirty_t *d)
+{
+    DirtyMark(d, 0, MAX_MEM_SZ);
+}
+
+// Generation of the last change to page, for readers that keep one per item
+// they cache instead of taking the bitmap each frame.
+static inline uint64_t DirtyPageGen(const dirty_t *d, unsigned page)
+{
+    return __atomic_load_n(&d->page[page], __ATOMIC_ACQUIRE);
+}
+
+// Whether page is set in a bitmap from DirtyTake().
+static inline bool DirtyTest(const uint64_t *pages, unsigned page)
+{
+    return (pages[page >> 6] >> (page & 63)) & 1;
+}
+
+// Set pages to the pages stamped after generation *since, and move *since to
+// the latest generation. A page stamped while this runs may be reported again
+// by the next call, never missed. Returns the number of pages set.
+unsigned DirtyTake(const dirty_t *d, uint64_t *since, uint64_t pages[DIRTY_WORDS]);
+
+#endif // DIRTY_H
@@ -0,0 +1,57 @@
+#include "disasm.h"
+#include "symbols.h"
+
+#define DISASM_BACK_MAX 64 // max instructions DisasmBack() can go back
+
+static disasm_entry_t cache[MAX_MEM_SZ];
+
+const disasm_entry_t *DisasmLookup(const byte *mem, word addr)
+{
+    disasm_entry_t *ent = &cache[addr];
+    if (ent->len && ent->gen == sym_gen)
+    {
+        unsigned i;
+        for (i = 0; i < ent->len && ent->bytes[i] == mem[(word)(addr + i)]; i++)
+            ;
+        if (i == ent->len)
+            return ent;
+    }
+    ent->len = op_format(mem, addr, ent->text, sizeof(ent->text), SymbolAt);
+    ent->gen = sym_gen;
+    for (unsigned i = 0; i < ent->len; i++)
+        ent->bytes[i] = mem[(word)(addr + i)];
+    return ent;
+}
+
+word DisasmBack(const byte *mem, word addr, unsigned n)
+{
+    if (n == 0)
+        return addr;
+    if (n > DISASM_BACK_MAX)
+        n = DISASM_BACK_MAX;
+    // the furthest candidate that decodes into addr has the best chance of
+    // being in sync with the real instruction stream
+    word starts[DISASM_BACK_MAX]; // ring of the last n instruction starts
+    word best = addr;
+    unsigned best_count = 0;
+    int first = (int)addr - 3 * (int)n;
+    if (first < 0)
+        first = 0;
+    for (int start = first; start < addr; start++)
+    {
+        unsigned count = 0;
+        unsigned pc = start;
+        while (pc < addr)
+        {
+            starts[count++ % n] = pc;
+            pc += DisasmLookup(mem, pc)->len;
+        }
+        if (pc != addr || count <= best_count)
+            continue;
+        best = starts[count >= n ? count % n : 0];
+        best_count = count;
+        if (count >= n)
+            break;
+    }
+    return best;
+}
@@ -0,0 +1,29 @@
+// Disassembly with a decode cache: each address keeps the text of the
+// instruction decoded there and the bytes it was decoded from, and is only
+// decoded again once those bytes or the symbols changed.
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include <stdint.h>
+
+#define DISASM_TEXT_SZ 48 // "LDA ($12),Y", or longer with a symbol
+
+typedef struct
+{
+    byte bytes[3];              // instruction bytes the text was decoded from
+    uint8_t len;                // instruction length, 0 if not decoded yet
+    char text[DISASM_TEXT_SZ];  // op_format() of the instruction
+    unsigned gen;               // sym_gen when it was decoded
+} disasm_entry_t;
+
+// Decoded instruction at addr in mem with its operand named by symbol, from
+// the cache unless its bytes or the symbols changed.
+const disasm_entry_t *DisasmLookup(const byte *mem, word addr);
+// Start of the instruction n instructions before addr, found by decoding
+// forward from the candidate starts before it. Returns addr if there is none.
+word DisasmBack(const byte *mem, word addr, unsigned n);
+
+#endif // DISASM_H
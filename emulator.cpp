@@ -0,0 +1,1433 @@
+#include "emulator.h"
+#include "rewind.h"
+#include "trace.h"
+#include "profiler.h"
+#include "heatmap.h"
+#include "delta.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+
+cpu_6502 *cpu; // our cpu!
+
+volatile bool cpu_running = false;
+volatile bool cpu_stepping = true;
+unsigned long cpufreq = 1000000; // 1 MHz
+uint64_t total_cycles = 0;
+
+static word last_instr_ptr = 0;   // instr_ptr after the last executed cycle
+static unsigned instr_cycles = 0; // cycles since instr_ptr last changed
+static word dirty_addr = 0;       // data written by the instruction at last_instr_ptr
+static unsigned dirty_len = 0;
+
+uint64_t bp_enabled[BP_BITMAP_SZ];        // enabled break points, one bit per address
+static uint64_t bp_defined[BP_BITMAP_SZ]; // all break points, enabled or not
+volatile unsigned bp_count = 0;           // number of enabled break points
+volatile unsigned bp_hit = ADDR_INVALID;
+
+cpu_watch_t watchpoints[WP_MAX];
+uint8_t wp_page[MAX_MEM_SZ >> 8];
+volatile unsigned wp_armed = 0;
+volatile cpu_watch_hit_t wp_hit;
+volatile cpu_watch_hit_t rom_hit;
+
+volatile cpu_step_t cpu_step_mode = STEP_NONE;
+static unsigned step_ret = ADDR_INVALID; // return address of the JSR being stepped over
+static byte step_sp = 0;                 // stack pointer when the step started
+
+static cpu_snapshot_t snapshot;             // registers published for the GUI
+static unsigned snapshot_seq = 0;           // odd while snapshot is being written
+static uint64_t snapshot_ns = 0;            // wall clock time of the last snapshot
+static byte snapshot_mem[MAX_MEM_SZ];       // memory published for the GUI
+static uint64_t snapshot_page[DIRTY_PAGES]; // generation of each page of snapshot_mem
+static uint64_t snapshot_gen = 0;           // snapshots that copied memory
+static uint64_t snapshot_dirty = 0;         // mem_dirty generation snapshot_mem is up to
+
+static cpu_cmd_t cmd_queue[CPU_CMD_QUEUE_SZ]; // commands from the GUI
+static unsigned cmd_head = 0;                  // next command to apply, owned by the CPU thread
+static unsigned cmd_tail = 0;                  // next free slot, owned by the GUI thread
+
+volatile unsigned rewind_cap_mb = 0;
+
+volatile bool trap_detect = true;
+volatile unsigned trap_success = FUNC_TEST_SUCCESS;
+volatile cpu_trap_t cpu_trap;
+static uint64_t run_start_ns = 0; // wall clock time of the last CPUStart()
+
+volatile bool cpu_batched = false;
+volatile bool cpu_batch_resync = true;
+static uint64_t batch_start_ns = 0;     // wall clock time at start of accounting
+static uint64_t batch_cycles = 0;       // cycles executed since start of accounting
+static unsigned long batch_cpufreq = 0; // frequency the accounting was started with
+
+volatile bool cpu_turbo = false;
+volatile double turbo_cps = 0;
+volatile double turbo_ips = 0;
+static volatile bool turbo_quit = false; // ask the turbo thread to exit
+static volatile bool clock_busy = false; // the clock callback is running the CPU
+static pthread_t turbo_thread;
+
+static void CPURunTo(cpu_step_t mode)
+{
+    run_start_ns = get_monotonic_ns();
+    instr_cycles = 0;
+    last_instr_ptr = cpu->instr_ptr;
+    bp_hit = ADDR_INVALID;
+    wp_hit.hit = false;
+    rom_hit.hit = false;
+    cpu_step_mode = mode;
+    cpu_stepping = false;
+    cpu_running = true;
+}
+
+void CPUStart()
+{
+    CPURunTo(STEP_NONE);
+}
+
+void CPUStep(cpu_step_t mode)
+{
+    if (mode == STEP_CYCLE)
+    {
+        cpu_step_mode = STEP_NONE;
+        cpu_stepping = true;
+        cpu_running = true;
+        return;
+    }
+    word ip = cpu->instr_ptr;
+    step_sp = cpu->sp;
+    step_ret = ADDR_INVALID;
+    if (mode == STEP_OVER)
+    {
+        if (cpu->mem[ip] == OPC_JSR)
+            step_ret = (word)(ip + 3);
+        else
+            mode = STEP_INSTR;
+    }
+    CPURunTo(mode);
+}
+
+// Stamp the data written by the last instruction, and decode what the one at
+// ip accesses for the dirty pages, and for the bus if it needs the bus_access
+// given in bus. Called on the first cycle of each instruction, when the write
+// of the previous one went through. Notes the bytes it accesses in the rewind
+// journal if rwd is set, before devices fill them in. Returns true if the one
+// at ip writes ROM and should stop, see BusAccess().
+static inline bool CPUAccessNext(word ip, uint8_t bus, bool devices, bool rwd = false)
+{
+    if (dirty_len)
+    {
+        DirtyMark(&mem_dirty, dirty_addr, dirty_len);
+        dirty_len = 0;
+    }
+    op_access_t acc;
+    bool data = (OPCODE_INFO[cpu->mem[ip]].access & (bus | OP_WRITE)) && op_access(cpu, ip, &acc);
+    if (bus)
+        BusRetire(cpu, devices);
+    if (rwd)
+        RewindBegin(cpu, data ? &acc : NULL);
+    bool rom = bus && BusAccess(cpu, data ? &acc : NULL, devices);
+    if (data && (acc.access & OP_WRITE))
+    {
+        // a stack write that wraps stays on the page of its first byte
+        dirty_addr = acc.addr;
+        dirty_len = op_access_head(&acc);
+    }
+    return rom;
+}
+
+// Stamp the data of the current instruction early, for readers that look at
+// memory while it is still executing.
+static void CPUDirtyFlush()
+{
+    if (dirty_len)
+        DirtyMark(&mem_dirty, dirty_addr, dirty_len);
+}
+
+// Stamp all of memory after it was replaced, and note what the instruction
+// the CPU is at accesses.
+static void CPUMemReplaced()
+{
+    DirtyMarkAll(&mem_dirty);
+    dirty_len = 0;
+    BusReset();
+    CPUAccessNext(last_instr_ptr, bus_access, false);
+}
+
+void CPURewindMark()
+{
+    if (rewind_journal == NULL)
+        return;
+    RewindClear();
+    // the history can only start on the first cycle of an instruction, where
+    // what it accesses is known
+    if (instr_cycles != 0)
+        return;
+    op_access_t acc;
+    bool data = OPCODE_INFO[cpu->mem[last_instr_ptr]].access && op_access(cpu, last_instr_ptr, &acc);
+    RewindBegin(cpu, data ? &acc : NULL);
+    RewindRecord(cpu, total_cycles);
+}
+
+// Journal the len bytes from addr before the debugger writes them.
+static void CPURewindPoke(word addr, unsigned len)
+{
+    if (rewind_journal != NULL)
+        RewindPoke(cpu, total_cycles, addr, len);
+}
+
+bool CPURewindEnable(unsigned cap_mb)
+{
+    bool ret = RewindEnable(cap_mb);
+    rewind_cap_mb = rewind_journal != NULL ? cap_mb : 0;
+    CPURewindMark();
+    CPUPublish(true);
+    return ret;
+}
+
+// Restore the state after cycles total cycles from the history, and stop there.
+static bool CPURewindTo(uint64_t cycles)
+{
+    if (!RewindUndo(cpu, cycles))
+        return false;
+    total_cycles = cycles;
+    last_instr_ptr = cpu->instr_ptr;
+    instr_cycles = 0;
+    // the debugger may have written ROM in the undone part
+    BusRomSync(cpu, 0, MAX_MEM_SZ);
+    CPUMemReplaced();
+    TraceTruncate(cycles);
+    ProfileBreak();
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    CPUPublish(true);
+    return true;
+}
+
+bool CPUStepBack()
+{
+    uint64_t cycles;
+    word ip;
+    if (!RewindFind(total_cycles, false, &cycles, &ip))
+        return false;
+    return CPURewindTo(cycles);
+}
+
+bool CPURunBack()
+{
+    uint64_t cycles;
+    word ip;
+    if (!RewindFind(total_cycles, true, &cycles, &ip))
+    {
+        // nothing to stop at, go back as far as the history reaches
+        uint64_t oldest = RewindOldest();
+        bp_hit = ADDR_INVALID;
+        return oldest < total_cycles && CPURewindTo(oldest);
+    }
+    if (!CPURewindTo(cycles))
+        return false;
+    bp_hit = ip;
+    return true;
+}
+
+void CPUClearTrap()
+{
+    cpu_trap.hit = false;
+    cpu_trap.success = false;
+    cpu_trap.addr = 0;
+    cpu_trap.cycles = 0;
+    cpu_trap.time = 0;
+}
+
+void CPUReset()
+{
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    total_cycles = 0;
+    cpu_reset(cpu);
+    // the core starts at the fetch of the first instruction without a change
+    // of instr_ptr, so prepare that instruction here
+    last_instr_ptr = cpu->instr_ptr;
+    instr_cycles = 0;
+    BusReset();
+    CPUAccessNext(last_instr_ptr, bus_access, true);
+    CPUClearTrap();
+    ProfileBreak();
+    CPURewindMark();
+    CPUPublish(true);
+}
+
+bool CPUCommand(cpu_cmd_type_t type, unsigned addr, unsigned long val, void *data)
+{
+    unsigned tail = __atomic_load_n(&cmd_tail, __ATOMIC_RELAXED);
+    if (tail - __atomic_load_n(&cmd_head, __ATOMIC_ACQUIRE) >= CPU_CMD_QUEUE_SZ)
+    {
+        free(data);
+        return false;
+    }
+    cpu_cmd_t *cmd = &cmd_queue[tail & (CPU_CMD_QUEUE_SZ - 1)];
+    cmd->type = type;
+    cmd->addr = addr;
+    cmd->val = val;
+    cmd->data = data;
+    __atomic_store_n(&cmd_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void CPUApply(const cpu_cmd_t *cmd)
+{
+    switch (cmd->type)
+    {
+    case CMD_START:
+        CPUStart();
+        break;
+    case CMD_PAUSE:
+        cpu_running = false;
+        cpu_step_mode = STEP_NONE;
+        if (cmd->val)
+            cpu_stepping = true;
+        break;
+    case CMD_STEP:
+        CPUStep((cpu_step_t)cmd->val);
+        break;
+    case CMD_RESET:
+        CPUReset();
+        break;
+    case CMD_SET_FREQ:
+        cpufreq = cmd->val;
+        break;
+    case CMD_BREAK_SET:
+        CPUBreakSet(cmd->addr, cmd->val);
+        break;
+    case CMD_BREAK_REMOVE:
+        CPUBreakRemove(cmd->addr);
+        break;
+    case CMD_BREAK_CLEAR:
+        CPUBreakClear();
+        break;
+    case CMD_WATCH_ADD:
+        CPUWatchAdd(cmd->addr, cmd->val & 0xffff, cmd->val >> 16);
+        break;
+    case CMD_WATCH_SET:
+        CPUWatchSet(cmd->addr, cmd->val);
+        break;
+    case CMD_WATCH_REMOVE:
+        CPUWatchRemove(cmd->addr);
+        break;
+    case CMD_ROM_SET:
+        if (BusProtect(cpu, cmd->addr, cmd->val & 0xffff, cmd->val >> 16))
+            CPUAccessNext(last_instr_ptr, bus_access, false);
+        break;
+    case CMD_ROM_TRAP:
+        bus_rom_trap = cmd->val;
+        break;
+    case CMD_WRITE_MEM:
+        if (cmd->addr >= MAX_MEM_SZ)
+            break;
+        CPURewindPoke(cmd->addr, 1);
+        cpu->mem[cmd->addr] = cmd->val;
+        DirtyMark(&mem_dirty, cmd->addr, 1);
+        BusRomSync(cpu, cmd->addr, 1);
+        CPUPublish(true);
+        break;
+    case CMD_WRITE_WORD:
+        if (cmd->addr >= MAX_MEM_SZ)
+            break;
+        CPURewindPoke(cmd->addr, 2);
+        cpu->mem[cmd->addr] = cmd->val;
+        cpu->mem[(cmd->addr + 1) & (MAX_MEM_SZ - 1)] = cmd->val >> 8;
+        DirtyMark(&mem_dirty, cmd->addr, 2);
+        BusRomSync(cpu, cmd->addr, 2);
+        CPUPublish(true);
+        break;
+    case CMD_WRITE_BLOCK:
+    {
+        if (cmd->addr >= MAX_MEM_SZ)
+            break;
+        unsigned len = cmd->val <= MAX_MEM_SZ - cmd->addr ? cmd->val : MAX_MEM_SZ - cmd->addr;
+        CPURewindPoke(cmd->addr, len);
+        memcpy(&cpu->mem[cmd->addr], cmd->data, len);
+        if (len)
+            DirtyMark(&mem_dirty, cmd->addr, len);
+        BusRomSync(cpu, cmd->addr, len);
+        CPUPublish(true);
+        break;
+    }
+    case CMD_LOAD:
+        CPULoadImage((const byte *)cmd->data, cmd->addr);
+        break;
+    case CMD_LOAD_RANGES:
+        CPULoadRanges((const load_t *)cmd->data, cmd->addr);
+        break;
+    case CMD_REWIND:
+        CPURewindEnable(cmd->val);
+        break;
+    case CMD_STEP_BACK:
+        CPUStepBack();
+        break;
+    case CMD_RUN_BACK:
+        CPURunBack();
+        break;
+    case CMD_TRACE_CLEAR:
+        TraceClear();
+        break;
+    case CMD_PROF_RESET:
+        ProfileReset();
+        break;
+    case CMD_PROF_ENABLE:
+        // the cycles run while disabled belong to no instruction
+        ProfileBreak();
+        prof_enabled = cmd->val;
+        break;
+    case CMD_HEAT_ENABLE:
+        heat_enabled = cmd->val;
+        break;
+    case CMD_TRACE_ENABLE:
+        TraceEnable(cmd->val);
+        break;
+    case CMD_BATCHED:
+        cpu_batched = cmd->val;
+        cpu_batch_resync = true;
+        break;
+    case CMD_TRAP_DETECT:
+        trap_detect = cmd->val;
+        break;
+    case CMD_TRAP_ADDR:
+        trap_success = cmd->addr;
+        break;
+    case CMD_STATE_SAVE:
+    case CMD_STATE_LOAD:
+    {
+        char fname[32];
+        snprintf(fname, sizeof(fname), STATE_SLOT_FILE, cmd->addr);
+        if (cmd->type == CMD_STATE_SAVE)
+            CPUStateSave(fname);
+        else
+            CPUStateLoad(fname);
+        break;
+    }
+    case CMD_RECORD:
+        if (cmd->val)
+            CPURecordStart(RECORD_FILE, cmd->val);
+        else
+            CPURecordStop();
+        break;
+    case CMD_RECORD_LOAD:
+        CPUDeltaLoad(RECORD_FILE, cmd->addr);
+        break;
+    default:
+        break;
+    }
+    free(cmd->data);
+}
+
+void CPUDrain()
+{
+    unsigned head = __atomic_load_n(&cmd_head, __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&cmd_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        CPUApply(&cmd_queue[head & (CPU_CMD_QUEUE_SZ - 1)]);
+        head++;
+        __atomic_store_n(&cmd_head, head, __ATOMIC_RELEASE);
+    }
+    if (record_active)
+        CPURecordPoll(false);
+}
+
+static void CPUTrap()
+{
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    instr_cycles = 0;
+    cpu_trap.addr = cpu->instr_ptr;
+    cpu_trap.success = cpu->instr_ptr == trap_success;
+    cpu_trap.cycles = total_cycles;
+    cpu_trap.time = (get_monotonic_ns() - run_start_ns) * 1e-9;
+    cpu_trap.hit = true;
+}
+
+static void CPUBreak()
+{
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    bp_hit = cpu->instr_ptr;
+}
+
+// Called on the first cycle of the instruction at ip, which follows the one at prev.
+static bool CPUStepDone(word prev, word ip)
+{
+    bool done;
+    switch (cpu_step_mode)
+    {
+    case STEP_OVER:
+        done = ip == step_ret && cpu->sp >= step_sp;
+        break;
+    case STEP_OUT:
+        done = cpu->mem[prev] == OPC_RTS && cpu->sp > step_sp;
+        break;
+    default:
+        done = true;
+        break;
+    }
+    if (!done)
+        return false;
+    cpu_step_mode = STEP_NONE;
+    cpu_running = false;
+    cpu_stepping = true;
+    return true;
+}
+
+static uint8_t CPUWatchMatch(word start, word end, uint8_t access)
+{
+    uint8_t match = 0;
+    for (int i = 0; i < WP_MAX; i++)
+    {
+        const cpu_watch_t *wp = &watchpoints[i];
+        if (wp->used && wp->enabled && start <= wp->end && end >= wp->start)
+            match |= wp->flags & access;
+    }
+    return match;
+}
+
+// Watch point flags in access of the ones overlapping the len bytes at addr,
+// which may wrap around the end of memory.
+static uint8_t CPUWatchRange(word addr, unsigned len, uint8_t access)
+{
+    word last = addr + len - 1;
+    if (!((wp_page[addr >> 8] | wp_page[last >> 8]) & access))
+        return 0;
+    if (last < addr)
+        return CPUWatchMatch(addr, 0xffff, access) | CPUWatchMatch(0, last, access);
+    return CPUWatchMatch(addr, last, access);
+}
+
+// Called on the first cycle of the instruction at ip, before it touches memory.
+// Execute watch points cover all bytes of the instruction, not only its opcode.
+static bool CPUWatchCheck(word ip)
+{
+    word addr = ip;
+    uint8_t match = CPUWatchRange(ip, ADDR_MODE_LEN[OPCODE_INFO[cpu->mem[ip]].mode], WP_EXEC);
+    op_access_t acc;
+    if (!match && op_access(cpu, ip, &acc))
+    {
+        unsigned head = op_access_head(&acc);
+        match = CPUWatchRange(acc.addr, head, acc.access & (WP_READ | WP_WRITE));
+        if (head < acc.len)
+            match |= CPUWatchRange(0x100, acc.len - head, acc.access & (WP_READ | WP_WRITE));
+        addr = acc.addr;
+    }
+    if (!match)
+        return false;
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    wp_hit.access = match;
+    wp_hit.addr = addr;
+    wp_hit.pc = ip;
+    wp_hit.cycles = total_cycles;
+    wp_hit.hit = true;
+    return true;
+}
+
+// Stop before the instruction at ip writes the protected byte bus_rom_addr.
+static void CPURomStop(word ip)
+{
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    rom_hit.access = WP_WRITE;
+    rom_hit.addr = bus_rom_addr;
+    rom_hit.pc = ip;
+    rom_hit.cycles = total_cycles;
+    rom_hit.hit = true;
+}
+
+static void CPUWatchUpdatePages()
+{
+    unsigned armed = 0;
+    memset(wp_page, 0, sizeof(wp_page));
+    for (int i = 0; i < WP_MAX; i++)
+    {
+        const cpu_watch_t *wp = &watchpoints[i];
+        if (!wp->used || !wp->enabled)
+            continue;
+        for (unsigned page = wp->start >> 8; page <= (unsigned)(wp->end >> 8); page++)
+            wp_page[page] |= wp->flags;
+        armed++;
+    }
+    wp_armed = armed;
+}
+
+void CPUPublish(bool force)
+{
+    uint64_t now = get_monotonic_ns();
+    if (!force && now - snapshot_ns < CPU_SNAPSHOT_NS)
+        return;
+    snapshot_ns = now;
+    if (force)
+        CPUDirtyFlush(); // stopped, maybe in the middle of a write
+    // seqlock: readers retry if the sequence is odd or changed while they copied
+    unsigned seq = __atomic_load_n(&snapshot_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&snapshot_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    snapshot.a = cpu->a;
+    snapshot.x = cpu->x;
+    snapshot.y = cpu->y;
+    snapshot.sp = cpu->sp;
+    snapshot.pc = cpu->pc;
+    snapshot.instr_ptr = cpu->instr_ptr;
+    snapshot.infer_addr = cpu->infer_addr;
+    snapshot.tmp = cpu->mem[cpu->infer_addr];
+    snapshot.n = cpu->n;
+    snapshot.v = cpu->v;
+    snapshot.rsvd = cpu->rsvd;
+    snapshot.b = cpu->b;
+    snapshot.d = cpu->d;
+    snapshot.i = cpu->i;
+    snapshot.z = cpu->z;
+    snapshot.c = cpu->c;
+    snapshot.cycle = (int)cpu->cycle;
+    snapshot.total_cycles = total_cycles;
+    snapshot.rewind_oldest = RewindOldest();
+    // the pages that changed, all of them the first time
+    uint64_t pages[DIRTY_WORDS];
+    bool all = snapshot_gen == 0;
+    if (DirtyTake(&mem_dirty, &snapshot_dirty, pages) || all)
+    {
+        snapshot_gen++;
+        for (unsigned page = 0; page < DIRTY_PAGES; page++)
+        {
+            if (!all && !DirtyTest(pages, page))
+                continue;
+            memcpy(&snapshot_mem[page << 8], &cpu->mem[page << 8], 256);
+            __atomic_store_n(&snapshot_page[page], snapshot_gen, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&snapshot_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void CPUSnapshot(cpu_snapshot_t *snap, cpu_mem_view_t *view)
+{
+    unsigned seq;
+    uint64_t gen[DIRTY_PAGES];
+    do
+    {
+        seq = __atomic_load_n(&snapshot_seq, __ATOMIC_ACQUIRE);
+        memcpy(snap, &snapshot, sizeof(cpu_snapshot_t));
+        // view->page only moves on once the copy is known not to be torn, so
+        // a page copied during a retry is copied again
+        for (unsigned page = 0; view != NULL && page < DIRTY_PAGES; page++)
+        {
+            gen[page] = __atomic_load_n(&snapshot_page[page], __ATOMIC_RELAXED);
+            if (gen[page] != view->page[page])
+                memcpy(&view->mem[page << 8], &snapshot_mem[page << 8], 256);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&snapshot_seq, __ATOMIC_RELAXED));
+    if (view != NULL)
+        memcpy(view->page, gen, sizeof(gen));
+}
+
+static void CPUExecCycle()
+{
+    cpu_exec(cpu);
+    if (cpu_stepping)
+        cpu_running = false;
+    total_cycles++;
+    if (cpu->instr_ptr != last_instr_ptr) // first cycle of a new instruction
+    {
+        word prev = last_instr_ptr;
+        last_instr_ptr = cpu->instr_ptr;
+        instr_cycles = 0;
+        bool rom = CPUAccessNext(last_instr_ptr, bus_access, true, rewind_journal != NULL);
+        if (trace_enabled.load(std::memory_order_acquire))
+            TraceRecord(cpu, total_cycles, trace_pos.load(std::memory_order_relaxed));
+        if (prof_enabled)
+            ProfileRecord(cpu, total_cycles);
+        if (heat_enabled)
+            HeatRecord(cpu);
+        if (rewind_journal != NULL)
+            RewindRecord(cpu, total_cycles);
+        if (bp_count && bp_test(last_instr_ptr))
+            CPUBreak();
+        else if (rom)
+            CPURomStop(last_instr_ptr);
+        else if (!(wp_armed && CPUWatchCheck(last_instr_ptr)) && cpu_step_mode != STEP_NONE)
+            CPUStepDone(prev, last_instr_ptr);
+    }
+    else
+    {
+        if (bus_pend.len)
+            BusUndoRom(cpu);
+        if (++instr_cycles >= TRAP_CYCLES && trap_detect)
+            CPUTrap();
+    }
+}
+
+void CPUCycle()
+{
+    TraceFileWait(1);
+    CPUExecCycle();
+    CPUPublish(!cpu_running);
+}
+
+void CPUBatch()
+{
+    if (!cpu_running)
+    {
+        cpu_batch_resync = true;
+        return;
+    }
+    if (cpu_stepping)
+    {
+        CPUCycle();
+        return;
+    }
+    // execute however many cycles are due since the last resync
+    uint64_t now = get_monotonic_ns();
+    unsigned long freq = cpufreq;
+    if (cpu_batch_resync || batch_cpufreq != freq)
+    {
+        cpu_batch_resync = false;
+        batch_start_ns = now;
+        batch_cycles = 0;
+        batch_cpufreq = freq;
+    }
+    uint64_t due = (now - batch_start_ns) * 1e-9 * freq;
+    if (due <= batch_cycles)
+        return;
+    uint64_t ncycles = due - batch_cycles;
+    uint64_t max_cycles = freq * CPU_BATCH_TICK_NS * CPU_BATCH_MAX_TICKS / NSEC_PER_SEC + 1;
+    if (ncycles > max_cycles) // fell too far behind, drop the debt instead of bursting
+    {
+        batch_cycles = due - max_cycles;
+        ncycles = max_cycles;
+    }
+    TraceFileWait(ncycles);
+    for (uint64_t i = 0; i < ncycles && cpu_running; i++)
+    {
+        CPUExecCycle();
+        batch_cycles++;
+    }
+    CPUPublish(!cpu_running);
+}
+
+uint64_t CPURunBlock(uint64_t ncycles, uint64_t *instrs)
+{
+    TraceFileWait(ncycles);
+    // run against local copies of the shared state
+    bool bps = bp_count != 0;
+    bool wps = wp_armed != 0;
+    bool steps = cpu_step_mode != STEP_NONE;
+    bool rwd = rewind_journal != NULL;
+    bool trc = trace_enabled.load(std::memory_order_acquire);
+    bool prof = prof_enabled;
+    bool heat = heat_enabled;
+    uint8_t bus = bus_access;
+    uint64_t tpos = trace_pos.load(std::memory_order_relaxed);
+    bool brk = false;
+    unsigned trap_limit = trap_detect ? TRAP_CYCLES : ~0u;
+    unsigned count = instr_cycles;
+    word instr_ptr = last_instr_ptr;
+    uint64_t ninstrs = 0;
+    uint64_t i;
+    for (i = 0; i < ncycles; i++)
+    {
+        cpu_exec(cpu);
+        if (cpu->instr_ptr != instr_ptr) // first cycle of a new instruction
+        {
+            word prev = instr_ptr;
+            instr_ptr = cpu->instr_ptr;
+            ninstrs++;
+            count = 0;
+            bool rom = CPUAccessNext(instr_ptr, bus, true, rwd);
+            if (trc)
+                tpos = TraceRecord(cpu, total_cycles + i + 1, tpos);
+            if (prof)
+                ProfileRecord(cpu, total_cycles + i + 1);
+            if (heat)
+                HeatRecord(cpu);
+            if (rwd)
+                RewindRecord(cpu, total_cycles + i + 1);
+            if (bps && bp_test(instr_ptr))
+            {
+                brk = true;
+                i++;
+                break;
+            }
+            if (rom)
+            {
+                CPURomStop(instr_ptr);
+                i++;
+                rom_hit.cycles = total_cycles + i;
+                break;
+            }
+            if (wps && CPUWatchCheck(instr_ptr))
+            {
+                i++;
+                wp_hit.cycles = total_cycles + i;
+                break;
+            }
+            if (steps && CPUStepDone(prev, instr_ptr))
+            {
+                i++;
+                break;
+            }
+        }
+        else
+        {
+            if (bus_pend.len)
+                BusUndoRom(cpu);
+            if (++count >= trap_limit)
+            {
+                i++;
+                break;
+            }
+        }
+    }
+    total_cycles += i;
+    instr_cycles = count;
+    last_instr_ptr = instr_ptr;
+    if (brk)
+        CPUBreak();
+    else if (count >= trap_limit)
+        CPUTrap();
+    if (instrs != NULL)
+        *instrs += ninstrs;
+    CPUPublish(!cpu_running);
+    return i;
+}
+
+static void *CPUTurboThread(void *id)
+{
+    uint64_t rate_ns = get_monotonic_ns();
+    uint64_t rate_cycles = total_cycles;
+    uint64_t instrs = 0;
+    while (!__atomic_load_n(&turbo_quit, __ATOMIC_ACQUIRE))
+    {
+        CPUDrain();
+        if (!cpu_running)
+        {
+            turbo_cps = 0;
+            turbo_ips = 0;
+            usleep(1000); // idle until started again
+            rate_ns = get_monotonic_ns();
+            rate_cycles = total_cycles;
+            instrs = 0;
+            continue;
+        }
+        if (cpu_stepping)
+        {
+            CPUCycle();
+            continue;
+        }
+        CPURunBlock(CPU_TURBO_CHECK_CYCLES, &instrs);
+        uint64_t now = get_monotonic_ns();
+        if (now - rate_ns >= CPU_TURBO_RATE_NS)
+        {
+            double dt = (now - rate_ns) * 1e-9;
+            turbo_cps = (total_cycles - rate_cycles) / dt;
+            turbo_ips = instrs / dt;
+            rate_ns = now;
+            rate_cycles = total_cycles;
+            instrs = 0;
+        }
+    }
+    turbo_cps = 0;
+    turbo_ips = 0;
+    return NULL;
+}
+
+bool CPUClockEnter()
+{
+    // pairs with CPUTurboStart(): either it sees clock_busy and waits, or
+    // this sees cpu_turbo and backs off
+    __atomic_store_n(&clock_busy, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cpu_turbo, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&clock_busy, false, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+void CPUClockLeave()
+{
+    __atomic_store_n(&clock_busy, false, __ATOMIC_RELEASE);
+}
+
+bool CPUTurboStart()
+{
+    if (__atomic_load_n(&cpu_turbo, __ATOMIC_ACQUIRE))
+        return true;
+    __atomic_store_n(&turbo_quit, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&cpu_turbo, true, __ATOMIC_SEQ_CST);
+    // wait for a clock callback already running the CPU to return
+    while (__atomic_load_n(&clock_busy, __ATOMIC_SEQ_CST))
+        usleep(100);
+    if (pthread_create(&turbo_thread, NULL, CPUTurboThread, NULL))
+    {
+        perror("CPUTurboStart: pthread_create: ");
+        __atomic_store_n(&cpu_turbo, false, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+void CPUTurboStop()
+{
+    if (!__atomic_load_n(&cpu_turbo, __ATOMIC_ACQUIRE))
+        return;
+    // the turbo thread owns the CPU until it has exited
+    __atomic_store_n(&turbo_quit, true, __ATOMIC_RELEASE);
+    pthread_join(turbo_thread, NULL);
+    cpu_batch_resync = true;
+    // hand the CPU back to the clock callback
+    __atomic_store_n(&cpu_turbo, false, __ATOMIC_RELEASE);
+}
+
+void CPUBreakSet(word addr, bool enabled)
+{
+    uint64_t mask = 1ULL << (addr & 63);
+    bool was_enabled = bp_test(addr);
+    bp_defined[addr >> 6] |= mask;
+    if (enabled && !was_enabled)
+    {
+        bp_enabled[addr >> 6] |= mask;
+        bp_count++;
+    }
+    else if (!enabled && was_enabled)
+    {
+        bp_enabled[addr >> 6] &= ~mask;
+        bp_count--;
+    }
+}
+
+void CPUBreakRemove(word addr)
+{
+    CPUBreakSet(addr, false);
+    bp_defined[addr >> 6] &= ~(1ULL << (addr & 63));
+}
+
+void CPUBreakClear()
+{
+    memset(bp_enabled, 0, sizeof(bp_enabled));
+    memset(bp_defined, 0, sizeof(bp_defined));
+    bp_count = 0;
+}
+
+bool CPUBreakIsSet(word addr)
+{
+    return (bp_defined[addr >> 6] >> (addr & 63)) & 1;
+}
+
+int CPUBreakNext(unsigned addr)
+{
+    // skip over empty words of the bitmap
+    while (addr < MAX_MEM_SZ)
+    {
+        uint64_t bits = bp_defined[addr >> 6] >> (addr & 63);
+        if (bits)
+            return addr + __builtin_ctzll(bits);
+        addr = (addr | 63) + 1;
+    }
+    return -1;
+}
+
+int CPUWatchAdd(word start, word end, uint8_t flags)
+{
+    if (end < start)
+    {
+        word tmp = start;
+        start = end;
+        end = tmp;
+    }
+    for (int i = 0; i < WP_MAX; i++)
+    {
+        cpu_watch_t *wp = &watchpoints[i];
+        if (wp->used)
+            continue;
+        wp->start = start;
+        wp->end = end;
+        wp->flags = flags;
+        wp->enabled = true;
+        wp->used = true;
+        CPUWatchUpdatePages();
+        return i;
+    }
+    return -1;
+}
+
+void CPUWatchSet(int idx, bool enabled)
+{
+    if (idx < 0 || idx >= WP_MAX || !watchpoints[idx].used)
+        return;
+    watchpoints[idx].enabled = enabled;
+    CPUWatchUpdatePages();
+}
+
+void CPUWatchRemove(int idx)
+{
+    if (idx < 0 || idx >= WP_MAX)
+        return;
+    watchpoints[idx].used = false;
+    watchpoints[idx].enabled = false;
+    CPUWatchUpdatePages();
+}
+
+word CPUGetVector(word addr)
+{
+    return cpu->mem[addr] | ((word)cpu->mem[addr + 1]) << 8;
+}
+
+bool CPUBusMap(unsigned first, unsigned npages, bus_kind_t kind, const bus_device_t *dev)
+{
+    if (!BusMap(cpu, first, npages, kind, dev))
+        return false;
+    CPUAccessNext(last_instr_ptr, bus_access, false);
+    return true;
+}
+
+void CPUSetVector(word addr, word val)
+{
+    cpu->mem[addr] = val;
+    cpu->mem[addr + 1] = val >> 8;
+    DirtyMark(&mem_dirty, addr, 2);
+    BusRomSync(cpu, addr, 2);
+}
+
+byte *CPUReadBinary(const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (fp == NULL)
+    {
+        printf("Could not open binary file %s\n", fname);
+        return NULL;
+    }
+    byte *image = NULL;
+    // calculate size
+    fseek(fp, 0, SEEK_END);
+    ssize_t sz = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (sz != (ssize_t)MAX_MEM_SZ)
+    {
+        printf("Binary file size: %ld bytes, which is not equal to %d bytes\n", sz, (int)MAX_MEM_SZ);
+    }
+    else if ((image = (byte *)malloc(MAX_MEM_SZ)) == NULL)
+    {
+        perror("CPUReadBinary: malloc: ");
+    }
+    else
+    {
+        ssize_t rdsz = fread(image, 1, sz, fp);
+        if (rdsz == sz)
+        {
+            printf("Binary ROM read OK\n");
+        }
+        else
+        {
+            printf("Binary ROM read FAILED, read %ld bytes out of %ld bytes\n", rdsz, sz);
+            free(image);
+            image = NULL;
+        }
+    }
+    fclose(fp);
+    return image;
+}
+
+// Point the reset vector to reset_vec and reset, or keep running from the
+// changed memory if it is ADDR_INVALID.
+static void CPULoaded(unsigned reset_vec)
+{
+    BusRomSync(cpu, 0, MAX_MEM_SZ);
+    if (reset_vec != ADDR_INVALID)
+    {
+        printf("Setting RESET vector to 0x%X\n", reset_vec);
+        CPUSetVector(V_RESET, reset_vec);
+    }
+    CPUDeltaBase(); // with the vector, so that its page is not in every record
+    if (reset_vec != ADDR_INVALID)
+        CPUReset();
+    else
+        CPURewindMark();
+    CPUPublish(true);
+}
+
+void CPULoadImage(const byte *image, unsigned reset_vec)
+{
+    memcpy(cpu->mem, image, MAX_MEM_SZ);
+    CPUMemReplaced();
+    CPULoaded(reset_vec);
+}
+
+void CPULoadRanges(const load_t *ld, unsigned reset_vec)
+{
+    for (unsigned i = 0; i < MAX_MEM_SZ / 64; i++)
+    {
+        uint64_t bits = ld->used[i];
+        if (bits)
+            DirtyMark(&mem_dirty, i << 6, 64);
+        if (bits == ~0ULL)
+            memcpy(&cpu->mem[i << 6], &ld->image[i << 6], 64);
+        else
+        {
+            for (; bits; bits &= bits - 1)
+            {
+                unsigned addr = (i << 6) + __builtin_ctzll(bits);
+                cpu->mem[addr] = ld->image[addr];
+            }
+        }
+    }
+    CPULoaded(reset_vec);
+}
+
+static cpu_state_file_t state_file; // too large for the stack
+
+static void CPUStateGet(cpu_state_run_t *run)
+{
+    memset(run, 0, sizeof(*run));
+    run->total_cycles = total_cycles;
+    run->cpufreq = cpufreq;
+    run->trap_success = trap_success;
+    run->instr_cycles = instr_cycles;
+    run->instr_ptr = last_instr_ptr;
+}
+
+// Finish restoring a state after the CPU and the break points were copied.
+static void CPUStateSet(const cpu_state_run_t *run, const char *fname, uint64_t start)
+{
+    total_cycles = run->total_cycles;
+    cpufreq = run->cpufreq ? run->cpufreq : cpufreq;
+    trap_success = run->trap_success;
+    instr_cycles = run->instr_cycles;
+    last_instr_ptr = run->instr_ptr;
+    BusRomSync(cpu, 0, MAX_MEM_SZ);
+    CPUMemReplaced();
+    unsigned count = 0;
+    for (unsigned i = 0; i < BP_BITMAP_SZ; i++)
+        count += __builtin_popcountll(bp_enabled[i]);
+    bp_count = count;
+    cpu_running = false;
+    cpu_stepping = true;
+    cpu_step_mode = STEP_NONE;
+    cpu_batch_resync = true;
+    CPUClearTrap();
+    // the trace and the history belong to the replaced run
+    TraceClear();
+    ProfileBreak();
+    CPURewindMark();
+    CPUPublish(true);
+    printf("Restored state from %s in %.3f ms\n", fname, (get_monotonic_ns() - start) * 1e-6);
+}
+
+bool CPUStateSave(const char *fname)
+{
+    uint64_t start = get_monotonic_ns();
+    cpu_state_file_t *st = &state_file;
+    memset(st, 0, sizeof(*st));
+    memcpy(st->magic, STATE_FILE_MAGIC, sizeof(st->magic));
+    st->version = STATE_FILE_VERSION;
+    st->cpu_sz = sizeof(cpu_6502);
+    CPUStateGet(&st->run);
+    memcpy(st->bp_defined, bp_defined, sizeof(bp_defined));
+    memcpy(st->bp_enabled, bp_enabled, sizeof(bp_enabled));
+    memcpy(&st->cpu, cpu, sizeof(cpu_6502));
+    // write a temporary file and rename it, so that a failed save keeps the old state
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fname);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        printf("Could not create state file %s\n", tmp);
+        return false;
+    }
+    bool ok = write(fd, st, sizeof(*st)) == (ssize_t)sizeof(*st);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp, fname) != 0)
+    {
+        perror("CPUStateSave: ");
+        unlink(tmp);
+        return false;
+    }
+    printf("Saved state to %s in %.3f ms\n", fname, (get_monotonic_ns() - start) * 1e-6);
+    return true;
+}
+
+bool CPUStateLoad(const char *fname)
+{
+    uint64_t start = get_monotonic_ns();
+    cpu_state_file_t *st = &state_file;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Could not open state file %s\n", fname);
+        return false;
+    }
+    ssize_t sz = read(fd, st, sizeof(*st));
+    close(fd);
+    if (sz >= (ssize_t)sizeof(st->magic) && memcmp(st->magic, DELTA_FILE_MAGIC, sizeof(st->magic)) == 0)
+        return CPUDeltaLoad(fname, DELTA_LAST);
+    if (sz != (ssize_t)sizeof(*st) || memcmp(st->magic, STATE_FILE_MAGIC, sizeof(st->magic)) != 0)
+    {
+        printf("%s is not a state file\n", fname);
+        return false;
+    }
+    if (st->version != STATE_FILE_VERSION || st->cpu_sz != sizeof(cpu_6502))
+    {
+        printf("%s: unsupported state version %u\n", fname, st->version);
+        return false;
+    }
+    memcpy(cpu, &st->cpu, sizeof(cpu_6502));
+    memcpy(bp_defined, st->bp_defined, sizeof(bp_defined));
+    memcpy(bp_enabled, st->bp_enabled, sizeof(bp_enabled));
+    CPUStateSet(&st->run, fname, start);
+    return true;
+}
+
+// Compact states
+
+#define DELTA_REGS_SZ (sizeof(cpu_6502) - MAX_MEM_SZ) // cpu_6502 without mem
+#define DELTA_REC_MAX (sizeof(cpu_delta_hdr_t) + DELTA_REGS_SZ + DELTA_BOUND(2 * sizeof(bp_enabled)) + DELTA_PAGES * DELTA_BOUND(256))
+
+static byte delta_base[MAX_MEM_SZ]; // memory after the last load
+static uint32_t delta_base_hash = 0;
+static uint64_t delta_base_gen = 0; // mem_dirty generation of delta_base
+static byte delta_rec[DELTA_REC_MAX]; // record being written or read
+
+volatile bool record_active = false;
+volatile unsigned record_count = 0;
+volatile uint64_t record_bytes = 0;
+static FILE *record_fp = NULL;
+static uint64_t record_interval = 0;
+static uint64_t record_next = 0; // total_cycles at which the next state is due
+
+static uint32_t CPUDeltaHash(const byte *data, size_t n)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < n; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+void CPUDeltaBase()
+{
+    memcpy(delta_base, cpu->mem, MAX_MEM_SZ);
+    delta_base_hash = CPUDeltaHash(delta_base, MAX_MEM_SZ);
+    delta_base_gen = mem_dirty.gen;
+}
+
+// Encode the current state into delta_rec, returns its size.
+static size_t CPUDeltaEncode()
+{
+    if (delta_base_hash == 0) // no base taken, zeroed memory
+        delta_base_hash = CPUDeltaHash(delta_base, MAX_MEM_SZ);
+    CPUDirtyFlush();
+    cpu_delta_hdr_t *hdr = (cpu_delta_hdr_t *)delta_rec;
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, DELTA_FILE_MAGIC, sizeof(hdr->magic));
+    hdr->version = DELTA_FILE_VERSION;
+    hdr->cpu_sz = sizeof(cpu_6502);
+    hdr->base_hash = delta_base_hash;
+    CPUStateGet(&hdr->run);
+    byte *p = delta_rec + sizeof(*hdr);
+    size_t mem_off = offsetof(cpu_6502, mem);
+    memcpy(p, cpu, mem_off);
+    memcpy(p + mem_off, (const byte *)cpu + mem_off + MAX_MEM_SZ, DELTA_REGS_SZ - mem_off);
+    p += DELTA_REGS_SZ;
+    uint64_t bps[2 * BP_BITMAP_SZ];
+    memcpy(bps, bp_defined, sizeof(bp_defined));
+    memcpy(bps + BP_BITMAP_SZ, bp_enabled, sizeof(bp_enabled));
+    p += DeltaEncode((const byte *)bps, NULL, sizeof(bps), p);
+    for (unsigned page = 0; page < DELTA_PAGES; page++)
+    {
+        // pages not written since the base was taken still hold it
+        if (mem_dirty.page[page] <= delta_base_gen)
+            continue;
+        const byte *mem = &cpu->mem[page << 8];
+        const byte *base = &delta_base[page << 8];
+        if (memcmp(mem, base, 256) == 0)
+            continue;
+        hdr->pages[page >> 6] |= 1ULL << (page & 63);
+        p += DeltaEncode(mem, base, 256, p);
+    }
+    hdr->data_sz = p - delta_rec - sizeof(*hdr);
+    hdr->hash = CPUDeltaHash(delta_rec, sizeof(*hdr) + hdr->data_sz);
+    return p - delta_rec;
+}
+
+bool CPUDeltaSave(const char *fname, bool append)
+{
+    uint64_t start = get_monotonic_ns();
+    size_t sz = CPUDeltaEncode();
+    FILE *fp = fopen(fname, append ? "ab" : "wb");
+    if (fp == NULL)
+    {
+        printf("Could not create state file %s\n", fname);
+        return false;
+    }
+    bool ok = fwrite(delta_rec, 1, sz, fp) == sz;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok)
+    {
+        perror("CPUDeltaSave: ");
+        return false;
+    }
+    printf("Saved %zu byte state to %s in %.3f ms\n", sz, fname, (get_monotonic_ns() - start) * 1e-6);
+    return true;
+}
+
+bool CPUDeltaLoad(const char *fname, unsigned index)
+{
+    uint64_t start = get_monotonic_ns();
+    FILE *fp = fopen(fname, "rb");
+    if (fp == NULL)
+    {
+        printf("Could not open state file %s\n", fname);
+        return false;
+    }
+    // skip to the record, the last one is the one before the end
+    cpu_delta_hdr_t *hdr = (cpu_delta_hdr_t *)delta_rec;
+    long pos = -1;
+    unsigned i = 0;
+    for (; i <= index; i++)
+    {
+        long at = ftell(fp);
+        if (fread(hdr, sizeof(*hdr), 1, fp) != 1)
+            break;
+        if (memcmp(hdr->magic, DELTA_FILE_MAGIC, sizeof(hdr->magic)) != 0 || hdr->data_sz > DELTA_REC_MAX - sizeof(*hdr))
+        {
+            pos = -1;
+            break;
+        }
+        pos = at;
+        if (fseek(fp, hdr->data_sz, SEEK_CUR) != 0)
+            break;
+    }
+    if (index != DELTA_LAST && i <= index)
+        pos = -1;
+    bool ok = pos >= 0 && fseek(fp, pos, SEEK_SET) == 0 && fread(hdr, sizeof(*hdr), 1, fp) == 1 &&
+              fread(delta_rec + sizeof(*hdr), 1, hdr->data_sz, fp) == hdr->data_sz;
+    fclose(fp);
+    if (!ok)
+    {
+        printf("%s has no state %u\n", fname, index);
+        return false;
+    }
+    if (hdr->version != DELTA_FILE_VERSION || hdr->cpu_sz != sizeof(cpu_6502) || hdr->data_sz < DELTA_REGS_SZ)
+    {
+        printf("%s: unsupported state version %u\n", fname, hdr->version);
+        return false;
+    }
+    uint32_t hash = hdr->hash;
+    hdr->hash = 0;
+    if (CPUDeltaHash(delta_rec, sizeof(*hdr) + hdr->data_sz) != hash)
+    {
+        printf("%s: state %u is corrupt\n", fname, index);
+        return false;
+    }
+    if (delta_base_hash == 0)
+        delta_base_hash = CPUDeltaHash(delta_base, MAX_MEM_SZ);
+    if (hdr->base_hash != delta_base_hash)
+    {
+        printf("%s was saved with another program loaded, load that first\n", fname);
+        return false;
+    }
+    // decode into a copy, so that a broken record leaves the state alone
+    static cpu_6502 next;
+    static uint64_t bps[2 * BP_BITMAP_SZ];
+    const byte *p = delta_rec + sizeof(*hdr);
+    const byte *end = p + hdr->data_sz;
+    size_t mem_off = offsetof(cpu_6502, mem);
+    memcpy(&next, p, mem_off);
+    memcpy((byte *)&next + mem_off + MAX_MEM_SZ, p + mem_off, DELTA_REGS_SZ - mem_off);
+    p += DELTA_REGS_SZ;
+    size_t n = DeltaDecode(p, end - p, NULL, (byte *)bps, sizeof(bps));
+    p += n;
+    for (unsigned page = 0; page < DELTA_PAGES && n; page++)
+    {
+        byte *mem = &next.mem[page << 8];
+        const byte *base = &delta_base[page << 8];
+        if (!((hdr->pages[page >> 6] >> (page & 63)) & 1))
+            memcpy(mem, base, 256);
+        else if ((n = DeltaDecode(p, end - p, base, mem, 256)) != 0)
+            p += n;
+    }
+    if (n == 0 || p != end)
+    {
+        printf("%s: state %u is corrupt\n", fname, index);
+        return false;
+    }
+    memcpy(cpu, &next, sizeof(cpu_6502));
+    memcpy(bp_defined, bps, sizeof(bp_defined));
+    memcpy(bp_enabled, bps + BP_BITMAP_SZ, sizeof(bp_enabled));
+    CPUStateSet(&hdr->run, fname, start);
+    return true;
+}
+
+bool CPURecordStart(const char *fname, uint64_t interval)
+{
+    CPURecordStop();
+    record_fp = fopen(fname, "wb");
+    if (record_fp == NULL)
+    {
+        printf("Could not create recording %s\n", fname);
+        return false;
+    }
+    record_interval = interval ? interval : RECORD_INTERVAL_DEFAULT;
+    record_next = total_cycles;
+    record_count = 0;
+    record_bytes = 0;
+    record_active = true;
+    CPURecordPoll(true);
+    return true;
+}
+
+void CPURecordPoll(bool force)
+{
+    if (record_fp == NULL)
+        return;
+    // total_cycles goes back on reset, rewind and restore
+    if (!force && total_cycles < record_next && total_cycles + record_interval >= record_next)
+        return;
+    size_t sz = CPUDeltaEncode();
+    if (fwrite(delta_rec, 1, sz, record_fp) != sz || fflush(record_fp) != 0)
+    {
+        perror("CPURecordPoll: ");
+        CPURecordStop();
+        return;
+    }
+    record_next = total_cycles + record_interval;
+    record_count++;
+    record_bytes += sz;
+}
+
+void CPURecordStop()
+{
+    if (record_fp == NULL)
+        return;
+    record_active = false;
+    fclose(record_fp);
+    record_fp = NULL;
+    printf("Recorded %u states in %llu bytes\n", record_count, (unsigned long long)record_bytes);
+}
+
+bool CPULoadBinary(const char *fname, word reset_vec)
+{
+    byte *image = CPUReadBinary(fname);
+    if (image == NULL)
+        return false;
+    CPULoadImage(image, reset_vec);
+    free(image);
+    return true;
+}
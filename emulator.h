@@ -0,0 +1,375 @@
+// Emulator core shared by the GUI and the headless runner.
+// Owns the CPU and its run state, and knows nothing about GLFW or ImGui.
+
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include "loader.h"
+#include "dirty.h"
+#include "bus.h"
+#include <stdint.h>
+#include <time.h>
+
+#include "clkgen.h"
+
+#define CPU_BATCH_TICK_NS 250000ULL // clock period in batched mode, 250 us
+#define CPU_BATCH_MAX_TICKS 8       // max number of ticks worth of cycles to catch up on
+
+#define CPU_TURBO_CHECK_CYCLES 4096          // cycles between checks of the shared run state
+#define CPU_TURBO_RATE_NS (NSEC_PER_SEC / 2) // update interval of the speed readout
+
+#define ADDR_INVALID 0x10000 // address outside of the 64 KiB memory space
+
+#define BP_BITMAP_SZ (MAX_MEM_SZ / 64) // 64-bit words in the break point bitmap
+
+#define WP_MAX 32          // number of watch point slots
+#define WP_READ OP_READ    // stop before a read
+#define WP_WRITE OP_WRITE  // stop before a write
+#define WP_EXEC 0x80       // stop before executing an instruction with a byte in the range
+
+typedef struct
+{
+    bool used;     // slot holds a watch point
+    bool enabled;  // watch point is armed
+    word start;    // first address of the range
+    word end;      // last address of the range
+    uint8_t flags; // WP_* flags
+} cpu_watch_t;
+
+typedef struct
+{
+    bool hit;        // a watch point fired since the last CPUStart()
+    uint8_t access;  // WP_* flags of the access that fired
+    word addr;       // address accessed
+    word pc;         // address of the accessing instruction
+    uint64_t cycles; // total_cycles when the watch point fired
+} cpu_watch_hit_t;
+
+#define CPU_SNAPSHOT_NS (NSEC_PER_SEC / 120) // min interval between register snapshots while running
+
+#define CPU_STEP_BLOCK_CYCLES 4096 // cycles per clock tick while running to a step target
+
+typedef struct
+{
+    byte a, x, y, sp;
+    word pc;
+    word instr_ptr;
+    word infer_addr;
+    byte tmp; // mem[infer_addr]
+    byte n, v, rsvd, b, d, i, z, c;
+    int cycle;              // index into CYCLE_NAME_6502
+    uint64_t total_cycles;  // total_cycles at the time of the snapshot
+    uint64_t rewind_oldest; // oldest total_cycles the history can restore, or UINT64_MAX
+} cpu_snapshot_t;
+
+// Memory as of a snapshot, for the GUI windows that show it instead of
+// reading cpu->mem while the CPU writes it. Only the pages that changed since
+// the last CPUSnapshot() into it are copied.
+typedef struct
+{
+    byte mem[MAX_MEM_SZ];
+    uint64_t page[DIRTY_PAGES]; // snapshot generation of each page, 0 before the first copy
+} cpu_mem_view_t;
+
+typedef enum
+{
+    STEP_NONE,  // not running to a step target
+    STEP_CYCLE, // execute a single cycle
+    STEP_INSTR, // stop at the next instruction
+    STEP_OVER,  // stop after the JSR at the current instruction returns
+    STEP_OUT    // stop after the current subroutine returns
+} cpu_step_t;
+
+#define CPU_CMD_QUEUE_SZ 1024 // commands that can be pending, power of 2
+
+typedef enum
+{
+    CMD_START,        // start running from the current state
+    CMD_PAUSE,        // stop running, val: enter stepping mode
+    CMD_STEP,         // val: cpu_step_t
+    CMD_RESET,        // reset the CPU and the cycle count
+    CMD_SET_FREQ,     // val: frequency in Hz
+    CMD_BREAK_SET,    // addr: break point, val: enabled
+    CMD_BREAK_REMOVE, // addr: break point
+    CMD_BREAK_CLEAR,  // remove all break points
+    CMD_WATCH_ADD,    // addr: start, val: end | (WP_* flags << 16)
+    CMD_WATCH_SET,    // addr: slot, val: enabled
+    CMD_WATCH_REMOVE, // addr: slot
+    CMD_ROM_SET,      // addr: start, val: end | (read-only << 16)
+    CMD_ROM_TRAP,     // val: stop before the CPU writes read-only memory
+    CMD_WRITE_MEM,    // addr: address, val: byte
+    CMD_WRITE_WORD,   // addr: address, val: little-endian word
+    CMD_WRITE_BLOCK,  // addr: address, val: length, data: bytes to free
+    CMD_LOAD,         // data: 64 KiB image to free, addr: reset vector or ADDR_INVALID
+    CMD_LOAD_RANGES,  // data: load_t to free, addr: reset vector or ADDR_INVALID
+    CMD_REWIND,       // val: memory cap of the rewind history in MiB, 0 to disable
+    CMD_STEP_BACK,    // restore the previous instruction boundary
+    CMD_RUN_BACK,     // restore the last boundary at an enabled break point
+    CMD_TRACE_CLEAR,  // drop the execution trace
+    CMD_PROF_RESET,   // zero the profiler counters
+    CMD_PROF_ENABLE,  // val: count while running
+    CMD_HEAT_ENABLE,  // val: count memory accesses while running
+    CMD_TRACE_ENABLE, // val: record the execution trace while running
+    CMD_BATCHED,      // val: run a batch of cycles per clock tick
+    CMD_TRAP_DETECT,  // val: stop on a branch or jump to itself
+    CMD_TRAP_ADDR,    // addr: address of the success trap
+    CMD_STATE_SAVE,   // addr: slot to save the machine state to
+    CMD_STATE_LOAD,   // addr: slot to restore the machine state from
+    CMD_RECORD,       // val: cycles between recorded states, 0 to stop recording
+    CMD_RECORD_LOAD,  // addr: index of the recorded state to restore
+} cpu_cmd_type_t;
+
+typedef struct
+{
+    uint8_t type;      // cpu_cmd_type_t
+    unsigned addr;     // address or slot
+    unsigned long val; // argument
+    void *data;        // malloc'd buffer owned by the command
+} cpu_cmd_t;
+
+#define FUNC_TEST_BIN "test/6502_functional_test.bin" // Klaus Dormann's 6502 functional test
+#define FUNC_TEST_RST 0x0400                          // entry point of the functional test
+#define FUNC_TEST_SUCCESS 0x3469                      // success trap of the functional test
+#define CUSTOM_RST 0xff00                             // reset vector for custom images
+
+#define TRAP_CYCLES 16 // cycles spent at the same instruction before it counts as a trap
+
+typedef struct
+{
+    bool hit;        // a trap was detected since the last reset or load
+    bool success;    // the trap address is the success address
+    word addr;       // address of the trapping instruction
+    uint64_t cycles; // total_cycles when the trap was detected
+    double time;     // wall time in seconds since the last CPUStart()
+} cpu_trap_t;
+
+#define STATE_FILE_MAGIC "6502SAV"     // 8 bytes including the terminator
+#define STATE_FILE_VERSION 1           // bump when cpu_state_file_t changes
+#define STATE_SLOTS 8                  // quick-save slots
+#define STATE_SLOT_FILE "slot%u.state" // file name of a quick-save slot
+
+// Run state saved along with the CPU.
+typedef struct
+{
+    uint64_t total_cycles;
+    uint64_t cpufreq;
+    uint32_t trap_success;
+    uint32_t instr_cycles;  // cycles spent at instr_ptr
+    uint16_t instr_ptr;     // instr_ptr after the last executed cycle
+    uint16_t reserved[3];
+} cpu_state_run_t;
+
+// Save state file, written and read with a single call. The vectors are part
+// of the memory in cpu.
+typedef struct
+{
+    char magic[8];          // STATE_FILE_MAGIC
+    uint32_t version;       // STATE_FILE_VERSION
+    uint32_t cpu_sz;        // sizeof(cpu_6502), states only load into the same core
+    cpu_state_run_t run;
+    uint64_t bp_defined[BP_BITMAP_SZ]; // break points, enabled or not
+    uint64_t bp_enabled[BP_BITMAP_SZ];
+    cpu_6502 cpu;           // registers, cycle, instr_ptr, infer_addr and memory
+} cpu_state_file_t;
+
+#define DELTA_FILE_MAGIC "6502DLT" // 8 bytes including the terminator
+#define DELTA_FILE_VERSION 1       // bump when cpu_delta_hdr_t or the record layout changes
+#define DELTA_PAGES (MAX_MEM_SZ >> 8)
+#define DELTA_LAST 0xffffffffu     // index of the last record in a file
+#define RECORD_FILE "session.rec"  // file the GUI records to
+#define RECORD_INTERVAL_DEFAULT 1000000 // cycles between recorded states
+
+// Compact save state: only the memory pages that differ from the memory right
+// after the last load (the base) are stored, delta coded against it, which
+// makes a typical state a few hundred bytes. Restoring needs the same base.
+// A recording is a file of these records back to back. Each is this header
+// followed by the cpu_6502 fields outside of mem, the break point bitmaps
+// (bp_defined then bp_enabled) delta coded against zeros, and the pages set
+// in pages[] delta coded against the base, in address order.
+typedef struct
+{
+    char magic[8];      // DELTA_FILE_MAGIC
+    uint32_t version;   // DELTA_FILE_VERSION
+    uint32_t cpu_sz;    // sizeof(cpu_6502)
+    uint32_t base_hash; // FNV-1a hash of the base memory
+    uint32_t data_sz;   // bytes of the record after the header
+    uint32_t hash;      // FNV-1a hash of the record with this field 0
+    uint32_t reserved;
+    cpu_state_run_t run;
+    uint64_t pages[DELTA_PAGES / 64]; // pages that differ from the base, one bit each
+} cpu_delta_hdr_t;
+
+extern volatile bool record_active;    // states are being recorded
+extern volatile unsigned record_count; // states in the recording
+extern volatile uint64_t record_bytes; // size of the recording
+
+extern cpu_6502 *cpu; // our cpu!
+
+// The run state below is written by the thread running the CPU only. Other
+// threads read it for display and change it through CPUCommand().
+
+extern volatile bool cpu_running;
+extern volatile bool cpu_stepping;
+extern unsigned long cpufreq;
+extern uint64_t total_cycles;
+
+extern uint64_t bp_enabled[BP_BITMAP_SZ]; // enabled break points, one bit per address
+extern volatile unsigned bp_count;        // number of enabled break points
+extern volatile unsigned bp_hit;          // break point the CPU last stopped at, or ADDR_INVALID
+
+extern cpu_watch_t watchpoints[WP_MAX];
+extern uint8_t wp_page[MAX_MEM_SZ >> 8]; // WP_* flags of the armed watch points in each page
+extern volatile unsigned wp_armed;        // number of armed watch points
+extern volatile cpu_watch_hit_t wp_hit;   // last watch point hit
+extern volatile cpu_watch_hit_t rom_hit;  // last write to read-only memory stopped at
+
+extern volatile cpu_step_t cpu_step_mode; // step the CPU is running to
+
+extern volatile unsigned rewind_cap_mb; // memory cap of the rewind history, 0 if disabled
+
+extern volatile bool trap_detect;      // stop on a branch or jump to itself, set with CMD_TRAP_DETECT
+extern volatile unsigned trap_success; // address of the success trap, set with CMD_TRAP_ADDR
+extern volatile cpu_trap_t cpu_trap;   // last detected trap
+
+extern volatile bool cpu_batched;      // run a batch of cycles per clock tick, set with CMD_BATCHED
+extern volatile bool cpu_batch_resync; // restart wall clock accounting
+
+extern volatile bool cpu_turbo;   // run unthrottled on the turbo thread
+extern volatile double turbo_cps; // achieved cycles per second
+extern volatile double turbo_ips; // achieved instructions per second
+
+static inline uint64_t get_monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// Start running from the current state, and restart the wall clock for trap timing.
+void CPUStart();
+
+// Clear the last detected trap.
+void CPUClearTrap();
+
+static inline bool bp_test(word addr)
+{
+    return (bp_enabled[addr >> 6] >> (addr & 63)) & 1;
+}
+
+// Queue a command for the thread running the CPU, single producer only.
+// Returns false if the queue is full, then the command is dropped and data freed.
+bool CPUCommand(cpu_cmd_type_t type, unsigned addr = 0, unsigned long val = 0, void *data = NULL);
+// Apply the queued commands, called by the thread running the CPU between batches.
+void CPUDrain();
+
+// Reset the CPU, the cycle count and the last trap, and stop in stepping mode.
+void CPUReset();
+
+// Allocate a rewind history of at most cap_mb MiB starting at the current
+// state, or free it if cap_mb is 0. It journals the memory each instruction
+// changes, the bytes devices filled in too, so going back works with devices
+// mapped; the devices themselves are not rewound.
+bool CPURewindEnable(unsigned cap_mb);
+// Drop the rewind history and start it over at the current state, after the
+// state was replaced from outside the CPU.
+void CPURewindMark();
+// Go back to the start of the previous instruction, or to the last instruction
+// at an enabled break point, and stop there. Returns false if the history does
+// not reach back far enough.
+bool CPUStepBack();
+bool CPURunBack();
+
+// Publish a snapshot of the registers, and of the memory pages stamped in
+// mem_dirty since the last one, from the thread running the CPU, at most once
+// per CPU_SNAPSHOT_NS unless force is set.
+void CPUPublish(bool force);
+// Read the last published snapshot, consistent even while the CPU is running.
+// If view is not NULL, bring it up to the memory of the same snapshot.
+void CPUSnapshot(cpu_snapshot_t *snap, cpu_mem_view_t *view = NULL);
+
+// Execute a single cycle, honoring break points, traps and stepping mode.
+void CPUCycle();
+
+// Execute the cycles that are due at cpufreq since the last resync (batched mode).
+void CPUBatch();
+
+// Execute up to ncycles back to back, stopping early at a break point or a trap.
+// Break points are checked once per instruction, on its first cycle.
+// Returns the number of cycles executed, and adds the number of instructions
+// started to *instrs if it is not NULL.
+uint64_t CPURunBlock(uint64_t ncycles, uint64_t *instrs);
+
+// Run at full speed to the next instruction boundary selected by mode, from
+// where the CPU is paused. Break points, watch points and traps still apply.
+// STEP_CYCLE executes a single cycle instead.
+void CPUStep(cpu_step_t mode);
+
+// Start and stop the turbo thread. Call from one thread only, they wait
+// until the clock callback or the turbo thread gave up the CPU.
+bool CPUTurboStart();
+void CPUTurboStop();
+// Bracket the clock callback's use of the CPU. CPUClockEnter() returns false,
+// and the callback must not touch the CPU, while the turbo thread owns it.
+bool CPUClockEnter();
+void CPUClockLeave();
+
+// Add a break point at addr, or update whether it is enabled.
+void CPUBreakSet(word addr, bool enabled);
+// Remove the break point at addr.
+void CPUBreakRemove(word addr);
+// Remove all break points.
+void CPUBreakClear();
+// Whether there is a break point at addr, enabled or not.
+bool CPUBreakIsSet(word addr);
+// First break point at or after addr, enabled or not, or -1 if there is none.
+int CPUBreakNext(unsigned addr);
+
+// Add a watch point on [start, end], returns its slot or -1 if all slots are used.
+int CPUWatchAdd(word start, word end, uint8_t flags);
+// Arm or disarm the watch point in slot idx, ignored if the slot is not in use.
+void CPUWatchSet(int idx, bool enabled);
+// Remove the watch point in slot idx, ignored if idx is not a slot.
+void CPUWatchRemove(int idx);
+
+// BusMap() on the CPU, dropping the rewind history if a device is mapped.
+bool CPUBusMap(unsigned first, unsigned npages, bus_kind_t kind, const bus_device_t *dev);
+
+// Read and write the little-endian vector at addr (V_RESET, V_NMI, V_IRQ_BRK).
+word CPUGetVector(word addr);
+void CPUSetVector(word addr, word val);
+
+// Read a 64 KiB memory image into a malloc'd buffer, or return NULL.
+byte *CPUReadBinary(const char *fname);
+// Copy a 64 KiB memory image into memory. Unless reset_vec is ADDR_INVALID, point
+// the reset vector to reset_vec and reset the CPU and the cycle count.
+void CPULoadImage(const byte *image, unsigned reset_vec);
+// Copy the addresses set by a loaded file into memory, leaving the others
+// alone, then handle reset_vec like CPULoadImage().
+void CPULoadRanges(const load_t *ld, unsigned reset_vec);
+// Save the machine state to fname. Returns false if it could not be written.
+bool CPUStateSave(const char *fname);
+// Restore the machine state from fname and stop there in stepping mode.
+// Compact state files restore their last record. Returns false, leaving the
+// state alone, if fname is not a valid state file.
+bool CPUStateLoad(const char *fname);
+// Save a compact state to fname, appending to it if append is set.
+bool CPUDeltaSave(const char *fname, bool append);
+// Make the current memory the base of the compact states. Loading a program
+// does this, call it once memory is set up if the program was not loaded.
+void CPUDeltaBase();
+// Restore the compact state at index in fname, or the last one if index is
+// DELTA_LAST, and stop there in stepping mode.
+bool CPUDeltaLoad(const char *fname, unsigned index);
+// Record a compact state to fname every interval cycles of running.
+bool CPURecordStart(const char *fname, uint64_t interval);
+// Record a state now if the interval passed, or anyway if force is set.
+// Called between batches by the thread running the CPU.
+void CPURecordPoll(bool force);
+// Stop recording and close the file.
+void CPURecordStop();
+// CPUReadBinary() followed by CPULoadImage().
+bool CPULoadBinary(const char *fname, word reset_vec);
+
+#endif // EMULATOR_H
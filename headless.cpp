@@ -0,0 +1,453 @@
+// Headless runner: loads a program into the emulator core and runs it to a
+// stop condition without any GLFW/ImGui dependency.
+
+#include "emulator.h" // 6502 CPU emulation core
+#include "trace.h"    // execution trace
+#include "profiler.h" // execution profiler
+#include "assembler.h" // 6502 assembler
+#include "symbols.h"   // symbol tables
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define HEADLESS_BLOCK_CYCLES 65536 // cycles between checks of the cycle budget
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options] <program>\n"
+                    "       %s [options] -a SOURCE [program]\n"
+                    "The program is a raw binary, Intel HEX, S-record or C64 PRG file, loaded\n"
+                    "into zeroed memory.\n"
+                    "Options:\n"
+                    "  -f FORMAT  program format: auto, raw, ihex, srec or prg (default: auto)\n"
+                    "  -L ADDR    load a raw program at ADDR (default: 0x0000)\n"
+                    "  -R FILE    resume from the state saved in FILE, after loading\n"
+                    "  -S FILE    save the state to FILE when stopping\n"
+                    "  -d CYCLES  with -S, record a compact state to FILE every CYCLES\n"
+                    "             cycles and when stopping instead\n"
+                    "  -a FILE    assemble FILE into memory over the program, with the reset\n"
+                    "             vector at its first byte if there is no program\n"
+                    "  -l FILE    load symbols from FILE, may be repeated; ADDR may then be\n"
+                    "             a symbol name\n"
+                    "  -r ADDR    reset vector (default: start address of the program, else\n"
+                    "             its reset vector, else its first byte)\n"
+                    "  -n ADDR    NMI vector (default: taken from image)\n"
+                    "  -i ADDR    IRQ/BRK vector (default: taken from image)\n"
+                    "  -b ADDR    stop at a break point at ADDR, may be repeated\n"
+                    "  -c CYCLES  stop after CYCLES cycles (default: unlimited)\n"
+                    "  -s ADDR    success trap address (default: 0x%04X)\n"
+                    "  -T         do not stop on a branch or jump to itself\n"
+                    "  -t COUNT   print the last COUNT instructions executed\n"
+                    "  -o FILE    write a binary trace of all instructions to FILE\n"
+                    "  -p COUNT   print the COUNT addresses that took the most cycles\n"
+                    "  -P ADDR    print the bytes the program writes to ADDR, which with the\n"
+                    "             rest of its page is mapped as a device\n"
+                    "  -w RANGE   make START or START-END read-only after loading, the\n"
+                    "             program's writes there are dropped, may be repeated\n"
+                    "  -W         stop before the program writes read-only memory\n"
+                    "  -h         show this help\n"
+                    "Exit status: 0 on break point, success trap or cycle budget, 2 if the\n"
+                    "cycle budget ran out before any break point, 3 on any other trap or on\n"
+                    "a write to read-only memory.\n",
+            name, name, FUNC_TEST_SUCCESS);
+}
+
+static bool parse_addr(const char *str, unsigned *addr)
+{
+    word sym;
+    if (SymbolFind(str, &sym))
+    {
+        *addr = sym;
+        return true;
+    }
+    char *end = NULL;
+    unsigned long num = strtoul(str, &end, 16);
+    if (end == str || *end != '\0' || num > MAX_MEM_SZ - 1)
+    {
+        fprintf(stderr, "Invalid address: %s\n", str);
+        return false;
+    }
+    *addr = num;
+    return true;
+}
+
+// Parse START or START-END into [*start, *end].
+static bool parse_range(const char *str, unsigned *start, unsigned *end)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", str);
+    char *dash = strchr(buf, '-');
+    if (dash != NULL)
+        *dash = '\0';
+    if (!parse_addr(buf, start) || !parse_addr(dash != NULL ? dash + 1 : buf, end))
+        return false;
+    if (*start > *end)
+    {
+        fprintf(stderr, "Invalid range: %s\n", str);
+        return false;
+    }
+    return true;
+}
+
+static unsigned out_port = ADDR_INVALID; // character output port
+static int out_last = '\n';              // last character written to it
+
+// Character output device: bytes written to out_port go to stdout, the rest
+// of its page acts as RAM.
+static void out_write(void *, word addr, byte val)
+{
+    if (addr != out_port)
+        return;
+    putchar(val);
+    out_last = val;
+}
+
+static const bus_device_t out_dev = {"output", NULL, out_write, NULL};
+
+static asm_t as;   // too large for the stack
+static load_t ld;  // program to load
+
+// Assemble the source file fname into as, printing the errors. Returns false on errors.
+static bool assemble_file(const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (fp == NULL)
+    {
+        printf("Could not open source file %s\n", fname);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *src = (char *)malloc(sz + 1);
+    if (src == NULL)
+    {
+        perror("assemble_file: malloc: ");
+        fclose(fp);
+        return false;
+    }
+    src[fread(src, 1, sz, fp)] = '\0';
+    fclose(fp);
+    uint64_t start = get_monotonic_ns();
+    bool ok = AsmAssemble(&as, src);
+    free(src);
+    for (unsigned i = 0; i < as.nerrors && i < ASM_MAX_ERRORS; i++)
+        printf("%s:%u: %s\n", fname, as.errors[i].line, as.errors[i].msg);
+    if (as.nerrors > ASM_MAX_ERRORS)
+        printf("%s: %u more errors\n", fname, as.nerrors - ASM_MAX_ERRORS);
+    if (ok)
+        printf("Assembled %u bytes from %u lines of %s in %.3f ms\n", as.bytes, as.nlines, fname, (get_monotonic_ns() - start) * 1e-6);
+    return ok;
+}
+
+static void print_state()
+{
+    printf("PC: 0x%04X  A: 0x%02X  X: 0x%02X  Y: 0x%02X  SP: 0x01%02X\n", cpu->pc, cpu->a, cpu->x, cpu->y, cpu->sp);
+    printf("Flags: N%d V%d -%d B%d D%d I%d Z%d C%d\n", cpu->n, cpu->v, cpu->rsvd, cpu->b, cpu->d, cpu->i, cpu->z, cpu->c);
+    printf("Instruction: 0x%04X  *TMP: 0x%04X  Cycle: %s\n", cpu->instr_ptr, cpu->infer_addr, CYCLE_NAME_6502[(int)cpu->cycle]);
+}
+
+static void print_profile(unsigned long count)
+{
+    // repeatedly pick the largest remaining count, fine for a short list
+    static bool shown[MAX_MEM_SZ];
+    uint64_t total = 0;
+    for (unsigned i = 0; i < MAX_MEM_SZ; i++)
+        total += prof_pc_cycles[i];
+    printf("Address  Count         Cycles        %%\n");
+    for (unsigned long n = 0; n < count; n++)
+    {
+        unsigned best = MAX_MEM_SZ;
+        for (unsigned i = 0; i < MAX_MEM_SZ; i++)
+            if (!shown[i] && prof_pc_count[i] && (best == MAX_MEM_SZ || prof_pc_cycles[i] > prof_pc_cycles[best]))
+                best = i;
+        if (best == MAX_MEM_SZ)
+            break;
+        shown[best] = true;
+        unsigned offset;
+        const char *name = SymbolNear(best, SYM_NEAR_MAX, &offset);
+        printf("0x%04X   %-12llu  %-12llu  %-6.2f", best, (unsigned long long)prof_pc_count[best], (unsigned long long)prof_pc_cycles[best], total ? 100.0 * prof_pc_cycles[best] / total : 0);
+        if (name == NULL)
+            printf("\n");
+        else if (offset)
+            printf("  %s+%u\n", name, offset);
+        else
+            printf("  %s\n", name);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t t_start = get_monotonic_ns();
+    unsigned reset_vec = ADDR_INVALID;
+    unsigned nmi_vec = ADDR_INVALID, irq_vec = ADDR_INVALID;
+    unsigned brk = ADDR_INVALID;
+    unsigned nbrk = 0;
+    unsigned ro_start, ro_end;
+    uint64_t max_cycles = 0; // unlimited
+    unsigned success = FUNC_TEST_SUCCESS;
+    unsigned long ntrace = 0;
+    const char *trace_file = NULL;
+    unsigned long nprof = 0;
+    const char *asm_file = NULL;
+    const char *state_in = NULL, *state_out = NULL;
+    uint64_t record_cycles = 0;
+    int load_fmt = LOAD_AUTO;
+    unsigned load_base = 0;
+    int opt;
+    // symbols first, so that the addresses below can name them
+    while ((opt = getopt(argc, argv, "l:f:L:R:S:d:r:n:i:b:c:s:Tt:o:p:P:w:Wa:h")) != -1)
+    {
+        if (opt == 'l' && SymbolsLoad(optarg) < 0)
+            return 1;
+    }
+    optind = 1;
+    while ((opt = getopt(argc, argv, "l:f:L:R:S:d:r:n:i:b:c:s:Tt:o:p:P:w:Wa:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            break;
+        case 'f':
+            load_fmt = LoadFormatParse(optarg);
+            if (load_fmt < 0)
+            {
+                fprintf(stderr, "Invalid format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'L':
+            if (!parse_addr(optarg, &load_base))
+                return 1;
+            break;
+        case 'r':
+            if (!parse_addr(optarg, &reset_vec))
+                return 1;
+            break;
+        case 'n':
+            if (!parse_addr(optarg, &nmi_vec))
+                return 1;
+            break;
+        case 'i':
+            if (!parse_addr(optarg, &irq_vec))
+                return 1;
+            break;
+        case 'b':
+            if (!parse_addr(optarg, &brk))
+                return 1;
+            CPUBreakSet(brk, true);
+            nbrk++;
+            break;
+        case 'c':
+            max_cycles = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            if (!parse_addr(optarg, &success))
+                return 1;
+            break;
+        case 'T':
+            trap_detect = false;
+            break;
+        case 't':
+            ntrace = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            trace_file = optarg;
+            break;
+        case 'p':
+            nprof = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            if (!parse_addr(optarg, &out_port))
+                return 1;
+            break;
+        case 'w':
+            if (!parse_range(optarg, &ro_start, &ro_end))
+                return 1;
+            break;
+        case 'W':
+            bus_rom_trap = true;
+            break;
+        case 'a':
+            asm_file = optarg;
+            break;
+        case 'R':
+            state_in = optarg;
+            break;
+        case 'S':
+            state_out = optarg;
+            break;
+        case 'd':
+            record_cycles = strtoull(optarg, NULL, 10);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 && !((asm_file != NULL || state_in != NULL) && optind == argc))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    // malloc CPU
+    cpu = (cpu_6502 *)malloc(sizeof(cpu_6502));
+    if (cpu == NULL)
+    {
+        perror("main: malloc: ");
+        exit(-1);
+    }
+    memset(cpu->mem, 0, MAX_MEM_SZ);
+    if (optind < argc)
+    {
+        if (!LoadFile(&ld, argv[optind], (load_format_t)load_fmt, load_base))
+        {
+            free(cpu);
+            return 1;
+        }
+        if (reset_vec == ADDR_INVALID)
+            reset_vec = LoadEntry(&ld);
+    }
+    if (asm_file != NULL)
+    {
+        if (!assemble_file(asm_file))
+        {
+            free(cpu);
+            return 1;
+        }
+        for (unsigned addr = 0; addr < MAX_MEM_SZ; addr++)
+        {
+            if (AsmUsed(&as, addr))
+            {
+                ld.image[addr] = as.image[addr];
+                LoadMark(&ld, addr, 1);
+            }
+        }
+        if (reset_vec == ADDR_INVALID && as.start >= 0)
+            reset_vec = as.start;
+    }
+    if (reset_vec == ADDR_INVALID)
+        reset_vec = CUSTOM_RST;
+    CPULoadRanges(&ld, reset_vec);
+    if (nmi_vec != ADDR_INVALID)
+        CPUSetVector(V_NMI, nmi_vec);
+    if (irq_vec != ADDR_INVALID)
+        CPUSetVector(V_IRQ_BRK, irq_vec);
+    if (state_in != NULL)
+    {
+        if (!CPUStateLoad(state_in))
+        {
+            free(cpu);
+            return 1;
+        }
+        // add the break points given here to the restored ones
+        optind = 1;
+        while ((opt = getopt(argc, argv, "l:f:L:R:S:d:r:n:i:b:c:s:Tt:o:p:P:w:Wa:h")) != -1)
+            if (opt == 'b' && parse_addr(optarg, &brk))
+                CPUBreakSet(brk, true);
+    }
+    if (out_port != ADDR_INVALID && !CPUBusMap(out_port >> 8, 1, BUS_DEVICE, &out_dev))
+    {
+        free(cpu);
+        return 1;
+    }
+    // protect the loaded contents
+    optind = 1;
+    while ((opt = getopt(argc, argv, "l:f:L:R:S:d:r:n:i:b:c:s:Tt:o:p:P:w:Wa:h")) != -1)
+    {
+        if (opt == 'w' && parse_range(optarg, &ro_start, &ro_end) && !BusProtect(cpu, ro_start, ro_end, true))
+        {
+            free(cpu);
+            return 1;
+        }
+    }
+    printf("Vectors: RESET 0x%04X  NMI 0x%04X  IRQ 0x%04X\n", CPUGetVector(V_RESET), CPUGetVector(V_NMI), CPUGetVector(V_IRQ_BRK));
+
+    trap_success = success;
+    prof_enabled = nprof > 0;
+    if ((ntrace > 0 && !TraceEnable(true)) || (trace_file != NULL && !TraceFileStart(trace_file)))
+    {
+        free(cpu);
+        return 1;
+    }
+    if (state_out != NULL && record_cycles && !CPURecordStart(state_out, record_cycles))
+    {
+        free(cpu);
+        return 1;
+    }
+    uint64_t instrs = 0;
+    uint64_t t_run = get_monotonic_ns();
+    CPUStart();
+    while (cpu_running)
+    {
+        uint64_t ncycles = HEADLESS_BLOCK_CYCLES;
+        if (max_cycles)
+        {
+            if (total_cycles >= max_cycles)
+                break;
+            if (max_cycles - total_cycles < ncycles)
+                ncycles = max_cycles - total_cycles;
+        }
+        CPURunBlock(ncycles, &instrs);
+        CPURecordPoll(false);
+    }
+    TraceFileStop();
+    uint64_t t_end = get_monotonic_ns();
+    if (out_last != '\n')
+        putchar('\n');
+    if (record_active)
+    {
+        CPURecordPoll(true);
+        CPURecordStop();
+    }
+    else if (state_out != NULL)
+        CPUStateSave(state_out);
+
+    int ret = 0;
+    if (cpu_trap.hit)
+    {
+        printf("Trapped at 0x%04X: %s, after %llu cycles and %.3f s\n", cpu_trap.addr, cpu_trap.success ? "SUCCESS" : "FAILURE", (unsigned long long)cpu_trap.cycles, cpu_trap.time);
+        if (!cpu_trap.success)
+            ret = 3;
+    }
+    else if (rom_hit.hit)
+    {
+        printf("Stopped on ROM write to 0x%04X by 0x%04X at cycle %llu\n", rom_hit.addr, rom_hit.pc, (unsigned long long)rom_hit.cycles);
+        ret = 3;
+    }
+    else if (bp_hit != ADDR_INVALID)
+        printf("Stopped at break point 0x%04X\n", bp_hit);
+    else
+    {
+        printf("Stopped after cycle budget of %llu cycles\n", (unsigned long long)max_cycles);
+        if (nbrk)
+            ret = 2;
+    }
+    if (ntrace)
+    {
+        uint64_t end = trace_pos.load(std::memory_order_acquire);
+        uint64_t first = TraceFirst(end);
+        char line[TRACE_LINE_SZ];
+        for (uint64_t pos = end - first > ntrace ? end - ntrace : first; pos < end; pos++)
+        {
+            const trace_entry_t *ent = TraceEntry(pos);
+            TraceFormat(ent, line, sizeof(line));
+            const char *name = SymbolAt(TRACE_PC(ent));
+            printf(name != NULL ? "%s  %s\n" : "%s\n", line, name);
+        }
+    }
+    if (trace_file != NULL)
+        printf("Trace: %llu instructions written to %s\n", (unsigned long long)trace_file_count, trace_file);
+    if (nprof)
+        print_profile(nprof);
+    print_state();
+    double dt = (t_end - t_run) * 1e-9;
+    printf("Total Cycles: %llu  Instructions: %llu\n", (unsigned long long)total_cycles, (unsigned long long)instrs);
+    printf("Run time: %.3f s (%.2f MHz, %.2f MIPS), startup: %.3f ms\n", dt, dt > 0 ? total_cycles / dt * 1e-6 : 0, dt > 0 ? instrs / dt * 1e-6 : 0, (t_run - t_start) * 1e-6);
+    free(cpu);
+    return ret;
+}
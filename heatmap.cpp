@@ -0,0 +1,7 @@
+#include "heatmap.h"
+
+uint32_t heat_read[MAX_MEM_SZ];
+uint32_t heat_write[MAX_MEM_SZ];
+uint32_t heat_exec[MAX_MEM_SZ];
+volatile bool heat_enabled = false;
+dirty_t heat_dirty;
@@ -0,0 +1,40 @@
+// Memory access heatmap: read, write and execute counts per address.
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include "dirty.h"
+#include <stdint.h>
+
+// The counters only grow and may wrap, readers look at their differences.
+extern uint32_t heat_read[MAX_MEM_SZ];  // data reads per address
+extern uint32_t heat_write[MAX_MEM_SZ]; // data writes per address
+extern uint32_t heat_exec[MAX_MEM_SZ];  // instruction bytes fetched per address
+extern volatile bool heat_enabled;      // count while running, set with CMD_HEAT_ENABLE
+extern dirty_t heat_dirty;              // pages whose counters changed
+
+// Count the accesses of the instruction at cpu->instr_ptr, called on its first cycle.
+static inline void HeatRecord(const cpu_6502 *cpu)
+{
+    word ip = cpu->instr_ptr;
+    unsigned len = ADDR_MODE_LEN[OPCODE_INFO[cpu->mem[ip]].mode];
+    for (unsigned k = 0; k < len; k++)
+        heat_exec[(word)(ip + k)]++;
+    DirtyMark(&heat_dirty, ip, len);
+    op_access_t acc;
+    if (!op_access(cpu, ip, &acc))
+        return;
+    DirtyMark(&heat_dirty, acc.addr, op_access_head(&acc));
+    for (unsigned k = 0; k < acc.len; k++)
+    {
+        word addr = op_access_addr(&acc, k);
+        if (acc.access & OP_READ)
+            heat_read[addr]++;
+        if (acc.access & OP_WRITE)
+            heat_write[addr]++;
+    }
+}
+
+#endif // HEATMAP_H
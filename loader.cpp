@@ -0,0 +1,347 @@
+#include "loader.h"
+#include "emulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char *const LOAD_FORMAT_NAME[LOAD_FORMAT_COUNT] = {"auto", "raw", "ihex", "srec", "prg"};
+
+void LoadMark(load_t *ld, word addr, unsigned n)
+{
+    if (n == 0)
+        return;
+    unsigned end = addr + n - 1;
+    for (unsigned a = addr; a <= end; a++)
+        ld->used[a >> 6] |= 1ULL << (a & 63);
+    if (ld->bytes == 0 || addr < ld->lo)
+        ld->lo = addr;
+    if (ld->bytes == 0 || end > ld->hi)
+        ld->hi = end;
+    ld->bytes += n;
+}
+
+unsigned LoadEntry(const load_t *ld)
+{
+    if (ld->entry != ADDR_INVALID)
+        return ld->entry;
+    if (LoadUsed(ld, V_RESET) && LoadUsed(ld, V_RESET + 1))
+        return ld->image[V_RESET] | (ld->image[V_RESET + 1] << 8);
+    return ld->bytes ? ld->lo : ADDR_INVALID;
+}
+
+int LoadFormatParse(const char *str)
+{
+    for (int i = 0; i < LOAD_FORMAT_COUNT; i++)
+        if (strcasecmp(str, LOAD_FORMAT_NAME[i]) == 0)
+            return i;
+    return -1;
+}
+
+static int LoadHexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c = tolower((byte)c);
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Decode n hex pairs at str into out, or only add them to sum if out is NULL.
+// Returns false on a bad digit, the caller checked that the pairs are there.
+static bool LoadHexBytes(const byte *str, byte *out, unsigned n, byte *sum)
+{
+    byte s = *sum;
+    for (unsigned i = 0; i < n; i++, str += 2)
+    {
+        int hi = LoadHexDigit(str[0]);
+        int lo = LoadHexDigit(str[1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        s += (hi << 4) | lo;
+        if (out != NULL)
+            out[i] = (hi << 4) | lo;
+    }
+    *sum = s;
+    return true;
+}
+
+// Whether the n hex pairs at str end the record in [str, end), followed by
+// the end of the line or white space.
+static bool LoadHexFits(const byte *str, const byte *end, unsigned n)
+{
+    return (size_t)(end - str) >= 2 * n && (str + 2 * n == end || isspace(str[2 * n]));
+}
+
+// Intel HEX record in [line, end): :LLAAAATT<data>CC, the bytes sum to 0.
+// Data records are decoded from the file straight into the image.
+static const char *LoadIhexLine(load_t *ld, const byte *line, const byte *end, unsigned long *ext, bool *eof)
+{
+    if (line[0] != ':')
+        return "not an Intel HEX record";
+    const byte *str = line + 1;
+    byte head[4], sum = 0;
+    if (end - str < 2 * 5)
+        return "bad record length";
+    if (!LoadHexBytes(str, head, 4, &sum))
+        return "bad hex digits";
+    unsigned len = head[0];
+    if (!LoadHexFits(str, end, len + 5))
+        return "bad record length";
+    str += 2 * 4;
+    unsigned long addr = *ext + ((head[1] << 8) | head[2]);
+    byte arg[4]; // leading bytes of the other records
+    unsigned narg = len < 4 ? len : 4;
+    bool ok;
+    if (head[3] == 0x00)
+    {
+        if (addr + len > MAX_MEM_SZ)
+            return "data beyond 64 KiB";
+        ok = LoadHexBytes(str, &ld->image[addr], len, &sum);
+    }
+    else
+        ok = LoadHexBytes(str, arg, narg, &sum) && LoadHexBytes(str + 2 * narg, NULL, len - narg, &sum);
+    if (!ok || !LoadHexBytes(str + 2 * len, NULL, 1, &sum))
+        return "bad hex digits";
+    if (sum != 0)
+        return "bad checksum";
+    unsigned long val = 0;
+    for (unsigned i = 0; i < narg; i++)
+        val = (val << 8) | arg[i];
+    switch (head[3])
+    {
+    case 0x00: // data
+        LoadMark(ld, addr, len);
+        return NULL;
+    case 0x01: // end of file
+        *eof = true;
+        return NULL;
+    case 0x02: // extended segment address
+        *ext = val << 4;
+        return NULL;
+    case 0x03: // start segment address, CS:IP
+        val = ((val >> 16) << 4) + (val & 0xffff);
+        break;
+    case 0x04: // extended linear address
+        *ext = val << 16;
+        return NULL;
+    case 0x05: // start linear address
+        break;
+    default:
+        return "unknown record type";
+    }
+    if (val >= MAX_MEM_SZ)
+        return "start address beyond 64 KiB";
+    ld->entry = val;
+    return NULL;
+}
+
+// S-record in [line, end): S<type><count><address><data><checksum>, the bytes
+// from count to checksum sum to 0xff. Data records are decoded from the file
+// straight into the image.
+static const char *LoadSrecLine(load_t *ld, const byte *line, const byte *end)
+{
+    // address bytes of S0 to S9
+    static const int ADDR_LEN[10] = {2, 2, 3, 4, -1, 2, 3, 4, 3, 2};
+    if (line[0] != 'S' || end - line < 2 || !isdigit(line[1]))
+        return "not an S-record";
+    int type = line[1] - '0';
+    int alen = ADDR_LEN[type];
+    if (alen < 0)
+        return "unknown record type";
+    const byte *str = line + 2;
+    byte head[5], sum = 0; // count and address
+    if (end - str < 2 * (alen + 2))
+        return "bad record length";
+    if (!LoadHexBytes(str, head, 1 + alen, &sum))
+        return "bad hex digits";
+    int n = head[0] + 1;
+    if (n < alen + 2 || !LoadHexFits(str, end, n))
+        return "bad record length";
+    str += 2 * (1 + alen);
+    unsigned long addr = 0;
+    for (int i = 0; i < alen; i++)
+        addr = (addr << 8) | head[1 + i];
+    unsigned len = n - alen - 2;
+    bool data = type >= 1 && type <= 3;
+    if (data && addr + len > MAX_MEM_SZ)
+        return "data beyond 64 KiB";
+    if (!LoadHexBytes(str, data ? &ld->image[addr] : NULL, len, &sum) || !LoadHexBytes(str + 2 * len, NULL, 1, &sum))
+        return "bad hex digits";
+    if (sum != 0xff)
+        return "bad checksum";
+    if (data)
+        LoadMark(ld, addr, len);
+    else if (type >= 7)
+    {
+        if (addr >= MAX_MEM_SZ)
+            return "start address beyond 64 KiB";
+        ld->entry = addr;
+    }
+    return NULL; // header and record counts
+}
+
+// Copy n bytes of the file into the image at base.
+static const char *LoadBytes(load_t *ld, const byte *data, size_t n, unsigned base)
+{
+    if (base + n > MAX_MEM_SZ)
+        return "data beyond 64 KiB";
+    memcpy(&ld->image[base], data, n);
+    LoadMark(ld, base, n);
+    return NULL;
+}
+
+static load_format_t LoadDetect(const byte *data, size_t sz, const char *fname)
+{
+    const char *ext = strrchr(fname, '.');
+    if (ext != NULL && strcasecmp(ext, ".prg") == 0)
+        return LOAD_PRG;
+    if (sz >= 1 && data[0] == ':')
+        return LOAD_IHEX;
+    if (sz >= 2 && data[0] == 'S' && isdigit(data[1]))
+        return LOAD_SREC;
+    return LOAD_RAW;
+}
+
+bool LoadFile(load_t *ld, const char *fname, load_format_t fmt, word base)
+{
+    int fd = open(fname, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        printf("Could not open program file %s\n", fname);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    // the file is read in place, mmap() fails on empty files
+    size_t sz = st.st_size;
+    const byte *data = NULL;
+    if (sz > 0)
+    {
+        void *map = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            perror("LoadFile: mmap: ");
+            close(fd);
+            return false;
+        }
+        madvise(map, sz, MADV_SEQUENTIAL);
+        data = (const byte *)map;
+    }
+    close(fd);
+    memset(ld->used, 0, sizeof(ld->used));
+    ld->bytes = ld->lo = ld->hi = 0;
+    ld->entry = ADDR_INVALID;
+    if (fmt == LOAD_AUTO)
+        fmt = LoadDetect(data, sz, fname);
+    ld->format = fmt;
+
+    const char *err = NULL;
+    unsigned lineno = 0;
+    if (fmt == LOAD_RAW)
+        err = LoadBytes(ld, data, sz, base);
+    else if (fmt == LOAD_PRG)
+        err = sz < 2 ? "missing load address" : LoadBytes(ld, data + 2, sz - 2, data[0] | (data[1] << 8));
+    else
+    {
+        unsigned long ext = 0; // Intel HEX extended address
+        bool eof = false;
+        for (size_t pos = 0; err == NULL && !eof && pos < sz;)
+        {
+            const byte *line = data + pos;
+            const byte *nl = (const byte *)memchr(line, '\n', sz - pos);
+            const byte *end = nl != NULL ? nl : data + sz;
+            pos = end - data + 1;
+            lineno++;
+            const byte *p = line;
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+                p++;
+            if (p == end)
+                continue;
+            else if (fmt == LOAD_IHEX)
+                err = LoadIhexLine(ld, line, end, &ext, &eof);
+            else
+                err = LoadSrecLine(ld, line, end);
+        }
+    }
+    if (data != NULL)
+        munmap((void *)data, sz);
+    if (err != NULL)
+    {
+        if (lineno)
+            printf("%s:%u: %s\n", fname, lineno, err);
+        else
+            printf("%s: %s\n", fname, err);
+        return false;
+    }
+    if (ld->bytes)
+        printf("Loaded %u bytes of %s at 0x%04X-0x%04X from %s\n", ld->bytes, LOAD_FORMAT_NAME[fmt], ld->lo, ld->hi, fname);
+    else
+        printf("No data in %s\n", fname);
+    return true;
+}
+
+static pthread_t load_thread;
+static load_t *load_job;            // result of the running or finished load
+static char load_fname[PATH_MAX];
+static load_format_t load_job_fmt;
+static word load_job_base;
+static volatile bool load_job_ok;
+volatile int load_state = LOAD_IDLE;
+
+static void *LoadThread(void *)
+{
+    load_job_ok = LoadFile(load_job, load_fname, load_job_fmt, load_job_base);
+    __atomic_store_n(&load_state, LOAD_DONE, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+bool LoadAsyncStart(const char *fname, load_format_t fmt, word base)
+{
+    if (load_state != LOAD_IDLE)
+        return false;
+    load_job = (load_t *)malloc(sizeof(load_t));
+    if (load_job == NULL)
+    {
+        perror("LoadAsyncStart: malloc: ");
+        return false;
+    }
+    snprintf(load_fname, sizeof(load_fname), "%s", fname);
+    load_job_fmt = fmt;
+    load_job_base = base;
+    load_state = LOAD_BUSY;
+    if (pthread_create(&load_thread, NULL, LoadThread, NULL))
+    {
+        perror("LoadAsyncStart: pthread_create: ");
+        free(load_job);
+        load_job = NULL;
+        load_state = LOAD_IDLE;
+        return false;
+    }
+    return true;
+}
+
+load_t *LoadAsyncTake()
+{
+    if (__atomic_load_n(&load_state, __ATOMIC_ACQUIRE) != LOAD_DONE)
+        return NULL;
+    pthread_join(load_thread, NULL);
+    load_t *ld = load_job;
+    load_job = NULL;
+    load_state = LOAD_IDLE;
+    if (!load_job_ok)
+    {
+        free(ld);
+        return NULL;
+    }
+    return ld;
+}
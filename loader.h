@@ -0,0 +1,68 @@
+// Program loader: reads Intel HEX, Motorola S-record, C64 PRG (two byte load
+// address header) and raw binaries at a base address. Files are mapped with
+// mmap() and decoded in a single pass straight into a 64 KiB image, along
+// with a bitmap of the addresses they set, so that loading only changes those
+// addresses. The GUI loads on a worker thread and hands the result to the CPU
+// thread with CMD_LOAD_RANGES, which applies it between two batches.
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include <stdint.h>
+
+typedef enum
+{
+    LOAD_AUTO, // by content: ':' Intel HEX, "S0".."S9" S-record, .prg PRG, else raw
+    LOAD_RAW,  // raw bytes at the base address
+    LOAD_IHEX, // Intel HEX
+    LOAD_SREC, // Motorola S-record
+    LOAD_PRG,  // little-endian load address followed by the bytes
+    LOAD_FORMAT_COUNT
+} load_format_t;
+
+extern const char *const LOAD_FORMAT_NAME[LOAD_FORMAT_COUNT];
+
+typedef enum
+{
+    LOAD_IDLE, // no background load
+    LOAD_BUSY, // the worker thread is loading
+    LOAD_DONE  // finished, waiting for LoadAsyncTake()
+} load_state_t;
+
+extern volatile int load_state; // load_state_t of the background load
+
+typedef struct
+{
+    byte image[MAX_MEM_SZ];         // loaded bytes
+    uint64_t used[MAX_MEM_SZ / 64]; // addresses set by the file, one bit each
+    unsigned bytes;                 // bytes loaded, counting overlaps
+    unsigned lo, hi;                // lowest and highest address loaded
+    unsigned entry;                 // start address given by the file, or ADDR_INVALID
+    uint8_t format;                 // load_format_t of the file
+} load_t;
+
+// Whether the file set addr.
+static inline bool LoadUsed(const load_t *ld, word addr)
+{
+    return (ld->used[addr >> 6] >> (addr & 63)) & 1;
+}
+// Load fname into ld, which needs no clearing. Raw files go to base. Prints
+// what was loaded, or the error and returns false.
+bool LoadFile(load_t *ld, const char *fname, load_format_t fmt, word base);
+// Mark [addr, addr + n) as set after writing ld->image there.
+void LoadMark(load_t *ld, word addr, unsigned n);
+// Reset vector for the loaded program: the start address given by the file,
+// else the reset vector if the file set it, else the lowest address loaded.
+// ADDR_INVALID if nothing was loaded.
+unsigned LoadEntry(const load_t *ld);
+// Start LoadFile() on a worker thread. Returns false if a load is already
+// running or the thread could not be started.
+bool LoadAsyncStart(const char *fname, load_format_t fmt, word base);
+// The malloc'd result once load_state is LOAD_DONE, then LOAD_IDLE again.
+// Returns NULL while loading, or if the load failed.
+load_t *LoadAsyncTake();
+// load_format_t named by str (raw, ihex, srec, prg, auto), or -1.
+int LoadFormatParse(const char *str);
+
+#endif // LOADER_H
@@ -7,11 +7,20 @@
 // **Prefer using the code in the example_glfw_opengl2/ folder**
 // See imgui_impl_glfw.cpp for details.
 
-#include "mos6502/c_6502.h" // 6502 CPU emulation
+#include "emulator.h" // 6502 CPU emulation core
+#include "rewind.h"   // rewind history
+#include "trace.h"    // execution trace
+#include "profiler.h" // execution profiler
+#include "heatmap.h"  // memory access heatmap
+#include "disasm.h"   // disassembly
+#include "assembler.h" // 6502 assembler
+#include "symbols.h"   // symbol tables
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
+#include <math.h>
 
 #define FONT_SZ 28.0f // max size
 #define FONT_SCALE 2  // default font is FONT_SZ/FONT_SCALE
@@ -46,32 +55,23 @@ static void glfw_error_callback(int error, const char *description)
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
-cpu_6502 *cpu; // our cpu!
-
-#include "clkgen.h"
-
-volatile bool cpu_running = false;
-volatile bool cpu_stepping = true;
-unsigned long cpufreq = 1000000;                               // 1 MHz
 volatile unsigned long long cpu_time = NSEC_PER_SEC / cpufreq; // 1 us
-uint64_t total_cycles = 0;
-volatile unsigned brk_ptr = 0x10000;
 
 void CPUHandler(clkgen_t clkid, void *data)
 {
-    if (cpu_running)
+    if (!CPUClockEnter()) // the turbo thread owns the CPU
+        return;
+    CPUDrain();
+    if (cpu_step_mode != STEP_NONE) // run to the step target at full speed
     {
-        if (cpu->pc == brk_ptr)
-        {
-            cpu_running = false;
-            cpu_stepping = true;
-            brk_ptr = 0x10000;
-        }
-        cpu_exec(cpu);
-        if (cpu_stepping)
-            cpu_running = false;
-        total_cycles++;
+        if (cpu_running)
+            CPURunBlock(CPU_STEP_BLOCK_CYCLES, NULL);
     }
+    else if (cpu_batched)
+        CPUBatch();
+    else if (cpu_running)
+        CPUCycle();
+    CPUClockLeave();
 }
 
 clkgen_t sysclk = 0;
@@ -83,6 +83,36 @@ static ImFont *HexWinFont;
 bool show_mem_editor = true;
 bool show_gui_settings = false;
 bool show_help_window = false;
+bool show_breakpoints = false;
+bool show_watchpoints = false;
+bool show_trace = false;
+bool show_profiler = false;
+bool show_heatmap = false;
+bool show_disasm = false;
+bool show_assembler = false;
+
+#define ASM_SRC_SZ (1 << 18) // max size of the assembler source
+
+// demo program, assembled into memory at startup and by Load Default
+#define DEMO_SOURCE           \
+    "; demo program\n"        \
+    "        .org $8000\n"    \
+    "start:  LDA #$00\n"      \
+    "loop:   NOP\n"           \
+    "        JMP (vector)\n"  \
+    "\n"                      \
+    "        .org $9000\n"    \
+    "vector: .word add\n"     \
+    "\n"                      \
+    "        .org $A000\n"    \
+    "add:    ADC #$09\n"      \
+    "        ADC #$05\n"      \
+    "        JMP loop\n"
+
+static asm_t asm_state;                        // lines and symbols of the last assembly
+static char asm_src[ASM_SRC_SZ] = DEMO_SOURCE; // assembler source
+static bool asm_pending = false;               // assembled bytes still to be written to memory
+static unsigned cmd_dropped = 0;               // commands lost because the CPU command queue was full
 
 void CPURun();
 void *CPUThread(void *);
@@ -90,6 +120,16 @@ void CodeEditor(bool *active);
 void CPURegisters(float);
 void GUISettings(bool *active);
 void HelpWindow(bool *active);
+void BreakpointWindow(bool *active);
+void WatchpointWindow(bool *active);
+void TraceWindow(bool *active);
+void ProfilerWindow(bool *active);
+void HeatmapWindow(bool *active);
+void DisassemblyWindow(bool *active);
+void AssemblerWindow(bool *active);
+static bool AsmWriteChanges(asm_t *as);
+static bool ParseAddress(const char *str, unsigned *addr);
+static bool GUICommand(cpu_cmd_type_t type, unsigned addr = 0, unsigned long val = 0, void *data = NULL);
 
 #define DEFAULT_RST 0x8000
 #define DEFAULT_NMI 0x0200
@@ -106,33 +146,24 @@ int main(int, char **)
         perror("main: malloc: ");
         exit(-1);
     }
+    memset(cpu->mem, 0, MAX_MEM_SZ);
     // set vectors
     static word RESET_VEC = DEFAULT_RST; // default reset location
     static word NMI_VEC = DEFAULT_NMI;   // default NMI handler
     static word IRQ_VEC = DEFAULT_IRQ;   // default IRQ/BRK handler
     // update vectors
-    cpu->mem[V_RESET] = RESET_VEC;
-    cpu->mem[V_RESET + 1] = RESET_VEC >> 8;
-    cpu->mem[V_NMI] = NMI_VEC;
-    cpu->mem[V_NMI + 1] = NMI_VEC >> 8;
-    cpu->mem[V_IRQ_BRK] = IRQ_VEC;
-    cpu->mem[V_IRQ_BRK + 1] = IRQ_VEC >> 8;
-    // fill out demo program
-    cpu->mem[0x8000] = LDA_IMM;
-    cpu->mem[0x8001] = 0x0;
-    cpu->mem[0x8002] = NOP;
-    cpu->mem[0x8003] = JMP_IND;
-    cpu->mem[0x8004] = 0x00;
-    cpu->mem[0x8005] = 0x90;
-    cpu->mem[0x9000] = 0x00;
-    cpu->mem[0x9001] = 0xa0;
-    cpu->mem[0xa000] = ADC_IMM;
-    cpu->mem[0xa001] = 0x09;
-    cpu->mem[0xa002] = ADC_IMM;
-    cpu->mem[0xa003] = 0x05;
-    cpu->mem[0xa004] = JMP_ABS;
-    cpu->mem[0xa005] = 0x02;
-    cpu->mem[0xa006] = 0x80;
+    CPUSetVector(V_RESET, RESET_VEC);
+    CPUSetVector(V_NMI, NMI_VEC);
+    CPUSetVector(V_IRQ_BRK, IRQ_VEC);
+    // assemble the demo program
+    if (AsmAssemble(&asm_state, asm_src))
+        for (unsigned addr = 0; addr < MAX_MEM_SZ; addr++)
+            if (AsmUsed(&asm_state, addr))
+                cpu->mem[addr] = asm_state.image[addr];
+    memset(asm_state.changed, 0, sizeof(asm_state.changed)); // in memory already
+    CPUDeltaBase();   // the same after a restart, so that recordings load again
+    CPUPublish(true); // initial register state for the GUI
+    TraceEnable(true); // always recording, so the instructions before a failure are there
     // Set up clock
     sysclk = create_clk(cpu_time, CPUHandler, NULL);
     // Setup window
@@ -226,8 +257,46 @@ int main(int, char **)
             HelpWindow(&show_help_window);
         }
 
+        if (show_breakpoints)
+        {
+            BreakpointWindow(&show_breakpoints);
+        }
+
+        if (show_watchpoints)
+        {
+            WatchpointWindow(&show_watchpoints);
+        }
+
+        if (show_trace)
+        {
+            TraceWindow(&show_trace);
+        }
+
+        if (show_profiler)
+        {
+            ProfilerWindow(&show_profiler);
+        }
+
+        if (show_heatmap)
+        {
+            HeatmapWindow(&show_heatmap);
+        }
+
+        if (show_disasm)
+        {
+            DisassemblyWindow(&show_disasm);
+        }
+
+        if (show_assembler)
+        {
+            AssemblerWindow(&show_assembler);
+        }
+
         CPURun();
 
+        if (asm_pending)
+            asm_pending = !AsmWriteChanges(&asm_state);
+
         // Rendering
         ImGui::Render();
         int display_w, display_h;
@@ -267,6 +336,8 @@ int main(int, char **)
     glfwTerminate();
 
     destroy_clk(sysclk);
+    CPUTurboStop();
+    TraceFileStop();
     free(cpu);
     return 0;
 }
@@ -282,7 +353,7 @@ void CPURun()
     static float usr_font_scale = 1.0f;
     ImGui::SetWindowFontScale(font_scale * usr_font_scale);
     float win_sz_x = (5 + 8 * 2) * font_scale * usr_font_scale * FONT_SZ;
-    float win_sz_y = 22 * font_scale * usr_font_scale * (FONT_SZ + 6 / font_scale / usr_font_scale);
+    float win_sz_y = 30 * font_scale * usr_font_scale * (FONT_SZ + 6 / font_scale / usr_font_scale);
     ImGui::SetWindowSize(ImVec2(win_sz_x, win_sz_y));
     float __usr_font_scale = usr_font_scale;
     // ImGui::PushItemWidth(15 * font_scale * usr_font_scale * FONT_SZ);
@@ -298,6 +369,17 @@ void CPURun()
     char tmp[25];
     ImGui::Text("Frequency: ");
     ImGui::SameLine();
+    static unsigned long seen_freq = cpufreq;
+    if (cpufreq != seen_freq) // also changed by restoring a state
+    {
+        seen_freq = cpufreq;
+        if (NSEC_PER_SEC / cpufreq != cpu_time)
+        {
+            cpu_time = NSEC_PER_SEC / cpufreq;
+            if (!cpu_batched)
+                sysclk = update_clk(sysclk, cpu_time);
+        }
+    }
     double _cpufreq = 0;
     if (cpufreq < 500)
     {
@@ -325,173 +407,252 @@ void CPURun()
         {
             num = 60; // 60 Hz
         }
-        cpufreq = num;
-        cpu_time = NSEC_PER_SEC / cpufreq;
-        sysclk = update_clk(sysclk, cpu_time);
+        GUICommand(CMD_SET_FREQ, 0, num);
+        cpu_time = NSEC_PER_SEC / num;
+        if (!cpu_batched) // batched mode keeps its tick period
+            sysclk = update_clk(sysclk, cpu_time);
     }
     ImGui::PopStyleColor();
-    ImGui::Text("Total Cycles: %llu", total_cycles);
+    ImGui::SameLine();
+    bool _cpu_batched = cpu_batched;
+    if (ImGui::Checkbox("Batched", &_cpu_batched))
+    {
+        GUICommand(CMD_BATCHED, 0, _cpu_batched);
+        sysclk = update_clk(sysclk, _cpu_batched ? CPU_BATCH_TICK_NS : cpu_time);
+    }
+    cpu_snapshot_t regs;
+    CPUSnapshot(&regs);
+    ImGui::Text("Total Cycles: %llu", (unsigned long long)regs.total_cycles);
+    if (cpu_turbo)
+    {
+        ImGui::SameLine();
+        ImGui::Text("\t%.2f MHz, %.2f MIPS", turbo_cps * 1e-6, turbo_ips * 1e-6);
+    }
+    ImGui::SameLine();
+    bool _prof_enabled = prof_enabled;
+    if (ImGui::Checkbox("Profile", &_prof_enabled))
+    {
+        GUICommand(CMD_PROF_ENABLE, 0, _prof_enabled);
+        if (_prof_enabled)
+            show_profiler = true;
+    }
+    if (prof_enabled)
+    {
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Reset##prof"))
+            GUICommand(CMD_PROF_RESET);
+    }
     ImGui::PushStyleColor(0, IMYLW);
     ImGui::Separator();
     ImGui::PopStyleColor();
     CPURegisters(font_scale * usr_font_scale);
     if (ImGui::Button("Reset CPU"))
     {
-        cpu_running = false;
-        cpu_stepping = true;
-        total_cycles = 0;
-        cpu_reset(cpu);
+        GUICommand(CMD_RESET);
     }
     ImGui::SameLine();
     if (ImGui::Button("Clear Memory"))
     {
-        cpu_running = false;
-        cpu_stepping = false;
-        for (unsigned i = 0; i < MAX_MEM_SZ; i++)
-            cpu->mem[i] = 0;
+        byte *image = (byte *)calloc(MAX_MEM_SZ, 1);
+        if (image != NULL)
+        {
+            GUICommand(CMD_PAUSE);
+            GUICommand(CMD_LOAD, ADDR_INVALID, 0, image);
+        }
     }
     ImGui::SameLine();
     if (ImGui::Button("Load Default"))
     {
-        cpu_running = false;
-        cpu_stepping = true;
+        GUICommand(CMD_PAUSE, 0, true);
         RESET_VEC = 0x8000; // default reset location
         NMI_VEC = 0x0200;   // default NMI handler
         IRQ_VEC = 0x0300;   // default IRQ/BRK handler
-        cpu->mem[V_RESET] = RESET_VEC;
-        cpu->mem[V_RESET + 1] = RESET_VEC >> 8;
-        cpu->mem[V_NMI] = NMI_VEC;
-        cpu->mem[V_NMI + 1] = NMI_VEC >> 8;
-        cpu->mem[V_IRQ_BRK] = IRQ_VEC;
-        cpu->mem[V_IRQ_BRK + 1] = IRQ_VEC >> 8;
-
-        cpu->mem[0x8000] = LDA_IMM;
-        cpu->mem[0x8001] = 0x0;
-        cpu->mem[0x8002] = NOP;
-        cpu->mem[0x8003] = JMP_IND;
-        cpu->mem[0x8004] = 0x00;
-        cpu->mem[0x8005] = 0x90;
-        cpu->mem[0x9000] = 0x00;
-        cpu->mem[0x9001] = 0xa0;
-        cpu->mem[0xa000] = ADC_IMM;
-        cpu->mem[0xa001] = 0x09;
-        cpu->mem[0xa002] = ADC_IMM;
-        cpu->mem[0xa003] = 0x05;
-        cpu->mem[0xa004] = JMP_ABS;
-        cpu->mem[0xa005] = 0x02;
-        cpu->mem[0xa006] = 0x80;
+        GUICommand(CMD_WRITE_WORD, V_RESET, RESET_VEC);
+        GUICommand(CMD_WRITE_WORD, V_NMI, NMI_VEC);
+        GUICommand(CMD_WRITE_WORD, V_IRQ_BRK, IRQ_VEC);
+
+        strcpy(asm_src, DEMO_SOURCE);
+        asm_pending = AsmAssemble(&asm_state, asm_src);
     }
     if (ImGui::Button("Start"))
     {
         if (!cpu_running)
         {
-            cpu_stepping = false;
-            cpu_running = true;
+            GUICommand(CMD_START);
         }
         else
         {
-            cpu_stepping = true;
-            cpu_running = false;
+            GUICommand(CMD_PAUSE, 0, true);
         }
     }
     ImGui::SameLine();
     if (ImGui::Button("Pause"))
     {
-        cpu_running = false;
+        GUICommand(CMD_PAUSE);
     }
     ImGui::SameLine();
     if (ImGui::Button("Step"))
     {
-        cpu_stepping = true;
-        cpu_running = true;
+        GUICommand(CMD_STEP, 0, STEP_CYCLE);
     }
     ImGui::SameLine();
-    if (ImGui::Button("Load Test"))
+    if (ImGui::Button("Step Instr"))
+        GUICommand(CMD_STEP, 0, STEP_INSTR);
+    ImGui::SameLine();
+    if (ImGui::Button("Step Over"))
+        GUICommand(CMD_STEP, 0, STEP_OVER);
+    ImGui::SameLine();
+    if (ImGui::Button("Step Out"))
+        GUICommand(CMD_STEP, 0, STEP_OUT);
+    ImGui::SameLine();
+    bool _cpu_turbo = cpu_turbo;
+    if (ImGui::Checkbox("Turbo", &_cpu_turbo))
     {
-        cpu_stepping = true;
-        cpu_running = false;
-        FILE *fp = fopen("test/6502_functional_test.bin", "rb");
-        if (fp != NULL)
+        if (_cpu_turbo)
+            CPUTurboStart();
+        else
+            CPUTurboStop();
+    }
+    // files load on a worker thread, the CPU keeps running until the result
+    // is applied between two batches
+    static unsigned load_reset = ADDR_INVALID; // reset vector for the load, or ADDR_INVALID for its own
+    static int load_fmt = LOAD_AUTO;
+    static unsigned load_base = 0;
+    if (load_state == LOAD_DONE)
+    {
+        load_t *ld = LoadAsyncTake();
+        if (ld != NULL && LoadEntry(ld) != ADDR_INVALID)
         {
-            // calculate size
-            fseek(fp, 0, SEEK_END);
-            ssize_t sz = ftell(fp);
-            fseek(fp, 0, SEEK_SET);
-
-            if (sz != 0x10000)
-            {
-                printf("Binary file size: %ld bytes, which is not equal to %d bytes\n", sz, 0x10000);
-            }
-            else
-            {
-                ssize_t rdsz = fread(cpu->mem, 1, sz, fp);
-                if (rdsz == sz)
-                {
-                    printf("Binary ROM read OK, setting RESET vector to 0x400\n");
-                    RESET_VEC = 0x400;
-                    cpu->mem[V_RESET] = RESET_VEC;
-                    cpu->mem[V_RESET + 1] = RESET_VEC >> 8;
-                    NMI_VEC = cpu->mem[V_NMI];
-                    NMI_VEC |= ((word)cpu->mem[V_NMI + 1]) << 8;
-                    IRQ_VEC = cpu->mem[V_IRQ_BRK];
-                    IRQ_VEC |= ((word)cpu->mem[V_IRQ_BRK + 1]) << 8;
-                    cpu_reset(cpu);
-                }
-                else
-                {
-                    printf("Binary ROM read FAILED, read %ld bytes out of %ld bytes\n", rdsz, sz);
-                }
-            }
-            fclose(fp);
+            RESET_VEC = load_reset != ADDR_INVALID ? load_reset : LoadEntry(ld);
+            if (LoadUsed(ld, V_NMI) && LoadUsed(ld, V_NMI + 1))
+                NMI_VEC = ld->image[V_NMI] | (ld->image[V_NMI + 1] << 8);
+            if (LoadUsed(ld, V_IRQ_BRK) && LoadUsed(ld, V_IRQ_BRK + 1))
+                IRQ_VEC = ld->image[V_IRQ_BRK] | (ld->image[V_IRQ_BRK + 1] << 8);
+            GUICommand(CMD_LOAD_RANGES, RESET_VEC, 0, ld);
+            ld = NULL;
         }
+        free(ld);
     }
+    if (ImGui::Button("Load Test") && LoadAsyncStart(FUNC_TEST_BIN, LOAD_RAW, 0))
+        load_reset = FUNC_TEST_RST;
+    ImGui::SameLine();
     if (ImGui::Button("Load Custom"))
     {
-        ImGuiFileDialog::Instance()->OpenDialog("ChooseDirDlgKey", "Choose Destination Directory", ".bin", ".");
+        ImGuiFileDialog::Instance()->OpenDialog("ChooseDirDlgKey", "Choose Program File", ".*,.bin,.hex,.ihx,.srec,.s19,.s28,.s37,.mot,.prg", ".");
     }
     if (ImGuiFileDialog::Instance()->Display("ChooseDirDlgKey"))
     {
         if (ImGuiFileDialog::Instance()->IsOk())
         {
             std::string filePath = ImGuiFileDialog::Instance()->GetFilePathName();
-            printf("Loading binary file: %s\n", filePath.c_str());
-            FILE *fp = NULL;
-            if ((fp = fopen(filePath.c_str(), "rb")) != NULL)
-            {
-                // calculate size
-                fseek(fp, 0, SEEK_END);
-                ssize_t sz = ftell(fp);
-                fseek(fp, 0, SEEK_SET);
-
-                if (sz != 0x10000)
-                {
-                    printf("Binary file size: %ld bytes, which is not equal to %d bytes\n", sz, 0x10000);
-                }
-                else
-                {
-                    ssize_t rdsz = fread(cpu->mem, 1, sz, fp);
-                    if (rdsz == sz)
-                    {
-                        printf("Binary ROM read OK, setting RESET vector to 0xFF00\n");
-                        RESET_VEC = 0xff00;
-                        cpu->mem[V_RESET] = RESET_VEC;
-                        cpu->mem[V_RESET + 1] = RESET_VEC >> 8;
-                        NMI_VEC = cpu->mem[V_NMI];
-                        NMI_VEC |= ((word)cpu->mem[V_NMI + 1]) << 8;
-                        IRQ_VEC = cpu->mem[V_IRQ_BRK];
-                        IRQ_VEC |= ((word)cpu->mem[V_IRQ_BRK + 1]) << 8;
-                        cpu_reset(cpu);
-                    }
-                    else
-                    {
-                        printf("Binary ROM read FAILED, read %ld bytes out of %ld bytes\n", rdsz, sz);
-                    }
-                }
-                fclose(fp);
-            }
+            printf("Loading program file: %s\n", filePath.c_str());
+            if (LoadAsyncStart(filePath.c_str(), (load_format_t)load_fmt, load_base))
+                load_reset = ADDR_INVALID;
         }
         ImGuiFileDialog::Instance()->Close();
     }
+    if (load_state != LOAD_IDLE)
+    {
+        ImGui::SameLine();
+        ImGui::Text("Loading...");
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Symbols"))
+    {
+        ImGuiFileDialog::Instance()->OpenDialog("ChooseSymDlgKey", "Choose Symbol File", ".dbg,.lbl,.sym,.txt", ".");
+    }
+    if (ImGuiFileDialog::Instance()->Display("ChooseSymDlgKey"))
+    {
+        if (ImGuiFileDialog::Instance()->IsOk())
+            SymbolsLoad(ImGuiFileDialog::Instance()->GetFilePathName().c_str());
+        ImGuiFileDialog::Instance()->Close();
+    }
+    if (sym_count)
+    {
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Symbols"))
+            SymbolsClear();
+        ImGui::SameLine();
+        ImGui::Text("%u symbols", sym_count);
+    }
+    ImGui::Text("Format:");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(8 * font_scale * usr_font_scale * FONT_SZ);
+    ImGui::Combo("##loadfmt", &load_fmt, "Auto\0Raw\0Intel HEX\0S-record\0C64 PRG\0");
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Text("Raw base: ");
+    ImGui::SameLine();
+    snprintf(tmp, sizeof(tmp), "0x%04X", load_base);
+    ImGui::PushStyleColor(0, IMCYN);
+    if (ImGui::SelectableInput("loadbase", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
+    {
+        unsigned num = strtoul(tmp, NULL, 16);
+        if (num < MAX_MEM_SZ)
+            load_base = num;
+    }
+    ImGui::PopStyleColor();
+    static int state_slot = 1;
+    ImGui::Text("State slot:");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(6 * font_scale * usr_font_scale * FONT_SZ);
+    if (ImGui::InputInt("##stateslot", &state_slot))
+    {
+        if (state_slot < 1)
+            state_slot = 1;
+        if (state_slot > STATE_SLOTS)
+            state_slot = STATE_SLOTS;
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Save State"))
+        GUICommand(CMD_STATE_SAVE, state_slot);
+    ImGui::SameLine();
+    if (ImGui::Button("Load State"))
+        GUICommand(CMD_STATE_LOAD, state_slot);
+    bool _record = record_active;
+    if (ImGui::Checkbox("Record", &_record))
+        GUICommand(CMD_RECORD, 0, _record ? RECORD_INTERVAL_DEFAULT : 0);
+    if (record_count)
+    {
+        static int record_idx = 0;
+        ImGui::SameLine();
+        ImGui::Text("%u states, %.1f KiB", record_count, record_bytes / 1024.0);
+        ImGui::SameLine();
+        ImGui::PushItemWidth(10 * font_scale * usr_font_scale * FONT_SZ);
+        ImGui::SliderInt("##recidx", &record_idx, 0, record_count - 1);
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        if (ImGui::Button("Restore"))
+            GUICommand(CMD_RECORD_LOAD, record_idx);
+    }
+    static int rewind_mb = REWIND_CAP_MB_DEFAULT;
+    bool _rewind = rewind_cap_mb != 0;
+    if (ImGui::Checkbox("Rewind", &_rewind))
+        GUICommand(CMD_REWIND, 0, _rewind ? rewind_mb : 0);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(6 * font_scale * usr_font_scale * FONT_SZ);
+    if (ImGui::InputInt("MiB", &rewind_mb, 16, 64, ImGuiInputTextFlags_EnterReturnsTrue))
+    {
+        if (rewind_mb < 1)
+            rewind_mb = 1;
+        if (rewind_mb > 4096)
+            rewind_mb = 4096;
+        if (rewind_cap_mb)
+            GUICommand(CMD_REWIND, 0, rewind_mb);
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Step Back"))
+        GUICommand(CMD_STEP_BACK);
+    ImGui::SameLine();
+    if (ImGui::Button("Run Back"))
+        GUICommand(CMD_RUN_BACK);
+    if (rewind_cap_mb && regs.rewind_oldest <= regs.total_cycles)
+    {
+        ImGui::SameLine();
+        ImGui::Text("%llu cycles", (unsigned long long)(regs.total_cycles - regs.rewind_oldest));
+    }
     ImGui::Separator();
     ImGui::Columns(2, "vector_inputs", false);
     ImGui::Text("Reset Vector: ");
@@ -500,14 +661,14 @@ void CPURun()
     ImGui::PushStyleColor(0, IMCYN);
     if (ImGui::SelectableInput("resetvec", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
     {
-        word num = strtoll(tmp, NULL, 16);
-        if (num > MAX_MEM_SZ - 1)
-            num = 0x8000; // 1 second
-        if (num == 0)
-            num = 0x400;
-        RESET_VEC = num;
-        cpu->mem[V_RESET] = RESET_VEC;
-        cpu->mem[V_RESET + 1] = RESET_VEC >> 8;
+        unsigned num;
+        if (ParseAddress(tmp, &num))
+        {
+            if (num == 0)
+                num = 0x400;
+            RESET_VEC = num;
+            GUICommand(CMD_WRITE_WORD, V_RESET, RESET_VEC);
+        }
     }
     ImGui::PopStyleColor();
     ImGui::NextColumn();
@@ -517,14 +678,14 @@ void CPURun()
     ImGui::PushStyleColor(0, IMCYN);
     if (ImGui::SelectableInput("nmivec", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
     {
-        word num = strtoll(tmp, NULL, 16);
-        if (num > MAX_MEM_SZ - 1)
-            num = 0x200; // 1 second
-        if (num == 0)
-            num = 0x200;
-        NMI_VEC = num;
-        cpu->mem[V_NMI] = NMI_VEC;
-        cpu->mem[V_NMI + 1] = NMI_VEC >> 8;
+        unsigned num;
+        if (ParseAddress(tmp, &num))
+        {
+            if (num == 0)
+                num = 0x200;
+            NMI_VEC = num;
+            GUICommand(CMD_WRITE_WORD, V_NMI, NMI_VEC);
+        }
     }
     ImGui::PopStyleColor();
     ImGui::NextColumn();
@@ -534,38 +695,79 @@ void CPURun()
     ImGui::PushStyleColor(0, IMCYN);
     if (ImGui::SelectableInput("irqvec", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
     {
-        word num = strtoll(tmp, NULL, 16);
-        if (num > MAX_MEM_SZ - 1)
-            num = 0x300; // 1 second
-        if (num == 0)
-            num = 0x300;
-        IRQ_VEC = num;
-        cpu->mem[V_IRQ_BRK] = IRQ_VEC;
-        cpu->mem[V_IRQ_BRK + 1] = IRQ_VEC >> 8;
+        unsigned num;
+        if (ParseAddress(tmp, &num))
+        {
+            if (num == 0)
+                num = 0x300;
+            IRQ_VEC = num;
+            GUICommand(CMD_WRITE_WORD, V_IRQ_BRK, IRQ_VEC);
+        }
     }
     ImGui::PopStyleColor();
     ImGui::NextColumn();
-    ImGui::Text("Break Ptr: ");
+    ImGui::Text("Add Break: ");
     ImGui::NextColumn();
-    if (brk_ptr != 0x10000)
-        snprintf(tmp, sizeof(tmp), "0x%04X", brk_ptr);
-    else
-        snprintf(tmp, sizeof(tmp), "INVL");
+    snprintf(tmp, sizeof(tmp), "----");
     ImGui::PushStyleColor(0, IMCYN);
     if (ImGui::SelectableInput("brkptr", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
     {
-        word num = strtoll(tmp, NULL, 16);
-        if (num > MAX_MEM_SZ - 1)
-            brk_ptr = 0x10000; // 1 second
-        else
-            brk_ptr = num;
+        unsigned num;
+        if (ParseAddress(tmp, &num))
+        {
+            GUICommand(CMD_BREAK_SET, num, true);
+            show_breakpoints = true;
+        }
+    }
+    ImGui::PopStyleColor();
+    ImGui::NextColumn();
+    ImGui::Text("Success Trap: ");
+    ImGui::NextColumn();
+    snprintf(tmp, sizeof(tmp), "0x%04X", trap_success);
+    ImGui::PushStyleColor(0, IMCYN);
+    if (ImGui::SelectableInput("trapsuccess", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
+    {
+        unsigned num;
+        if (ParseAddress(tmp, &num))
+            GUICommand(CMD_TRAP_ADDR, num);
     }
     ImGui::PopStyleColor();
     ImGui::Columns(1);
+    bool _trap_detect = trap_detect;
+    if (ImGui::Checkbox("Detect Traps", &_trap_detect))
+        GUICommand(CMD_TRAP_DETECT, 0, _trap_detect);
+    if (cpu_trap.hit)
+    {
+        ImGui::SameLine();
+        ImGui::PushStyleColor(0, cpu_trap.success ? IMGRN : IMRED);
+        ImGui::Text("%s at 0x%04X: %llu cycles, %.3f s", cpu_trap.success ? "PASS" : "FAIL", cpu_trap.addr, (unsigned long long)cpu_trap.cycles, cpu_trap.time);
+        ImGui::PopStyleColor();
+    }
+    if (cmd_dropped)
+        ImGui::TextColored(IMRED, "Command queue full, %u commands dropped", cmd_dropped);
+    if (rom_hit.hit)
+        ImGui::TextColored(IMRED, "ROM write: 0x%04X by 0x%04X at cycle %llu", rom_hit.addr, rom_hit.pc, (unsigned long long)rom_hit.cycles);
+    else if (wp_hit.hit)
+        ImGui::TextColored(IMRED, "Watch: %c 0x%04X by 0x%04X at cycle %llu", wp_hit.access & WP_WRITE ? 'W' : (wp_hit.access & WP_READ ? 'R' : 'X'), wp_hit.addr, wp_hit.pc, (unsigned long long)wp_hit.cycles);
+    else
+        ImGui::Text("Watch: %u armed", wp_armed);
     ImGui::PushStyleColor(0, IMYLW);
     ImGui::Separator();
     ImGui::PopStyleColor();
     ImGui::Checkbox("Show Memory Editor", &show_mem_editor);
+    ImGui::SameLine();
+    ImGui::Checkbox("Show Break Points", &show_breakpoints);
+    ImGui::SameLine();
+    ImGui::Checkbox("Show Watch Points", &show_watchpoints);
+    ImGui::SameLine();
+    ImGui::Checkbox("Show Trace", &show_trace);
+    ImGui::Checkbox("Show Profiler", &show_profiler);
+    ImGui::SameLine();
+    ImGui::Checkbox("Show Heatmap", &show_heatmap);
+    ImGui::SameLine();
+    ImGui::Checkbox("Show Disassembly", &show_disasm);
+    ImGui::SameLine();
+    ImGui::Checkbox("Show Assembler", &show_assembler);
     ImGui::Checkbox("Show Help Info", &show_help_window);
     ImGui::Checkbox("Show GUI Info", &show_gui_settings);
     ImGui::End();
@@ -576,18 +778,10 @@ void *CPUThread(void *id)
 {
     while (!done)
     {
+        CPUDrain();
         if (cpu_running)
         {
-            if (cpu->pc == brk_ptr)
-            {
-                cpu_running = false;
-                cpu_stepping = true;
-                brk_ptr = 0x10000;
-            }
-            cpu_exec(cpu);
-            if (cpu_stepping)
-                cpu_running = false;
-            total_cycles++;
+            CPUCycle();
         }
         usleep(cpu_time / 2); // 60 Hz
         // other devices can read from memory here
@@ -598,10 +792,12 @@ void *CPUThread(void *id)
 
 void CPURegisters(float font_scale)
 {
+    cpu_snapshot_t regs;
+    CPUSnapshot(&regs);
     ImGui::Text("A: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x%02X", cpu->a);
+    ImGui::Text("0x%02X", regs.a);
     ImGui::PopFont();
 
     ImGui::SameLine();
@@ -611,7 +807,7 @@ void CPURegisters(float font_scale)
     ImGui::Text("Cycle: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("%s", CYCLE_NAME_6502[(int)cpu->cycle]);
+    ImGui::Text("%s", CYCLE_NAME_6502[regs.cycle]);
     ImGui::PopFont();
 
     ImGui::SameLine();
@@ -621,13 +817,13 @@ void CPURegisters(float font_scale)
     ImGui::Text("*TMP: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x%04X", cpu->infer_addr);
+    ImGui::Text("0x%04X", regs.infer_addr);
     ImGui::PopFont();
 
     ImGui::Text("X: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x%02X", cpu->x);
+    ImGui::Text("0x%02X", regs.x);
     ImGui::PopFont();
     ImGui::SameLine();
     ImGui::Text("\t");
@@ -635,7 +831,7 @@ void CPURegisters(float font_scale)
     ImGui::Text("Y: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x%02X", cpu->y);
+    ImGui::Text("0x%02X", regs.y);
     ImGui::PopFont();
     ImGui::SameLine();
     ImGui::Text("\t");
@@ -643,13 +839,13 @@ void CPURegisters(float font_scale)
     ImGui::Text("TMP: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x%02X", cpu->mem[cpu->infer_addr]);
+    ImGui::Text("0x%02X", regs.tmp);
     ImGui::PopFont();
     ImGui::Separator();
     ImGui::Text("PC: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x%04X", cpu->pc);
+    ImGui::Text("0x%04X", regs.pc);
     ImGui::PopFont();
     ImGui::SameLine();
     ImGui::Text("\t");
@@ -657,7 +853,7 @@ void CPURegisters(float font_scale)
     ImGui::Text("SP: ");
     ImGui::SameLine();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("0x01%02X", cpu->sp);
+    ImGui::Text("0x01%02X", regs.sp);
     ImGui::PopFont();
     ImGui::Separator();
     ImGui::Columns(9);
@@ -687,42 +883,91 @@ void CPURegisters(float font_scale)
     ImGui::Text("Value");
     ImGui::NextColumn();
     ImGui::PushFont(HexWinFont);
-    ImGui::Text("%01X", cpu->n);
+    ImGui::Text("%01X", regs.n);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->v);
+    ImGui::Text("%01X", regs.v);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->rsvd);
+    ImGui::Text("%01X", regs.rsvd);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->b);
+    ImGui::Text("%01X", regs.b);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->d);
+    ImGui::Text("%01X", regs.d);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->i);
+    ImGui::Text("%01X", regs.i);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->z);
+    ImGui::Text("%01X", regs.z);
     ImGui::NextColumn();
-    ImGui::Text("%01X", cpu->c);
+    ImGui::Text("%01X", regs.c);
     ImGui::NextColumn();
     ImGui::PopFont();
     ImGui::Columns(1);
     ImGui::Separator();
 }
 
+#define MEM_VIEW_LINE_SZ 128 // buffer size for one row of the memory viewer
+#define MEM_VIEW_ADDR_CHARS 8 // "0x0000  " in front of the bytes of a row
+#define MEM_VIEW_CACHE 128    // formatted rows kept by the memory viewer, power of 2
+
+typedef struct
+{
+    int row, cols; // row of the view with cols bytes per row, cols 0 if unused
+    uint64_t gen;  // newest gui_mem generation of its pages when formatted
+    int n;         // length of text
+    char text[MEM_VIEW_LINE_SZ];
+} mem_view_row_t;
+
+static mem_view_row_t mem_view_rows[MEM_VIEW_CACHE]; // indexed by row
+static cpu_mem_view_t gui_mem;                        // memory shown by the viewer and the disassembly
+
+// Queue a command for the CPU thread, counting it in cmd_dropped if the queue
+// is full so the CPU window can show that it was lost.
+static bool GUICommand(cpu_cmd_type_t type, unsigned addr, unsigned long val, void *data)
+{
+    if (CPUCommand(type, addr, val, data))
+        return true;
+    cmd_dropped++;
+    return false;
+}
+
+// Parse a symbol name or a hexadecimal address, returns false if it is neither.
+static bool ParseAddress(const char *str, unsigned *addr)
+{
+    word sym;
+    if (SymbolFind(str, &sym))
+    {
+        *addr = sym;
+        return true;
+    }
+    if (str[0] == '$')
+        str++;
+    char *end;
+    unsigned long num = strtoul(str, &end, 16);
+    if (end == str || *end != '\0' || num >= MAX_MEM_SZ)
+        return false;
+    *addr = num;
+    return true;
+}
+
 void CodeEditor(bool *active)
 {
     ImGui::Begin("RAM Viewer and Editor", active);
     static float font_scale = 1.0f / FONT_SCALE;
     static float usr_font_scale = 1.0f;
     ImGui::SetWindowFontScale(font_scale * usr_font_scale);
-    static int baddr = 0x8000;
     static int rc[] = {16, 16};
-    float win_sz_x = (6 + rc[1] * 2) * font_scale * usr_font_scale * FONT_SZ;
-    float win_sz_y = (5 + rc[0]) * font_scale * usr_font_scale * (FONT_SZ + 6 / font_scale / usr_font_scale);
+    static bool follow = true;    // keep the PC in view while running
+    static int edit_addr = -1;    // byte being edited, or -1
+    static bool edit_focus = false;
+    static char edit_buf[3];
+    int scroll_to = -1;
+    cpu_snapshot_t regs;
+    CPUSnapshot(&regs, &gui_mem);
+    float win_sz_x = (7 + rc[1] * 2.5) * font_scale * usr_font_scale * FONT_SZ;
+    float win_sz_y = (6 + rc[0]) * font_scale * usr_font_scale * (FONT_SZ + 6 / font_scale / usr_font_scale);
     if (win_sz_x < (6 + 3 * 2) * font_scale * usr_font_scale * FONT_SZ)
         win_sz_x = (6 + 3 * 2) * font_scale * usr_font_scale * FONT_SZ;
     ImGui::SetWindowSize(ImVec2(win_sz_x, win_sz_y));
     float __usr_font_scale = usr_font_scale;
-    // ImGui::PushItemWidth(15 * font_scale * usr_font_scale * FONT_SZ);
     if (ImGui::InputFloat("Text Size", &__usr_font_scale, 0.1, 0.5, "%.1f"))
     {
         if (__usr_font_scale < 0.5)
@@ -736,7 +981,7 @@ void CodeEditor(bool *active)
     if (ImGui::InputText("##Row", buf, IM_ARRAYSIZE(buf), ImGuiInputTextFlags_EnterReturnsTrue))
     {
         int tmp = strtol(buf, NULL, 10);
-        if (tmp > 0 && tmp < 31)
+        if (tmp > 0 && tmp < 65)
             rc[0] = tmp;
     }
     ImGui::PopItemWidth();
@@ -753,127 +998,823 @@ void CodeEditor(bool *active)
             rc[1] = tmp;
         }
     }
-    ImGui::Columns(rc[1] + 1, "Offsets", false);
-    ImGui::SetColumnWidth(0, 4 * font_scale * usr_font_scale * FONT_SZ);
-    for (int i = 1; i < rc[1] + 1; i++)
-        ImGui::SetColumnWidth(i, 2 * font_scale * usr_font_scale * FONT_SZ);
+    ImGui::PopItemWidth();
+    ImGui::Text("Go to: ");
+    ImGui::SameLine();
+    char tmp[64] = "";
+    unsigned goto_addr;
+    ImGui::PushStyleColor(0, IMCYN);
+    if (ImGui::SelectableInput("baddr", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)) && ParseAddress(tmp, &goto_addr))
+        scroll_to = goto_addr;
+    ImGui::PopStyleColor();
+    ImGui::SameLine();
+    ImGui::Checkbox("Follow PC", &follow);
+
+    ImGui::PushFont(HexWinFont);
+    int cols = rc[1];
+    int nrows = (MAX_MEM_SZ + cols - 1) / cols;
+    float char_w = ImGui::CalcTextSize("0").x;
+    float line_h = ImGui::GetTextLineHeightWithSpacing();
+    char line[MEM_VIEW_LINE_SZ];
+    int n = snprintf(line, sizeof(line), "%-*s", MEM_VIEW_ADDR_CHARS, "Base");
+    for (int j = 0; j < cols; j++)
+        n += snprintf(line + n, sizeof(line) - n, "%02X ", j);
+    ImGui::TextUnformatted(line);
+    ImGui::Separator();
 
-    for (int i = -1; i < rc[0]; i++)
+    ImGui::BeginChild("memrows");
+    if (cpu_running && follow)
+        scroll_to = regs.pc;
+    if (scroll_to >= 0)
     {
-        if (i < 0) // print header
-        {
-            ImGui::Text("Base");
-            ImGui::NextColumn();
-            for (int j = 0; j < rc[1]; j++)
-            {
-                ImGui::Text("%02X", j);
-                ImGui::NextColumn();
-            }
-            ImGui::PushFont(HexWinFont);
-            ImGui::Separator();
-            continue;
-        }
-        for (int j = -1; j < rc[1]; j++)
+        // only scroll to the PC if it left the view, so that the rows stay put
+        float y = (scroll_to / cols) * line_h;
+        float top = ImGui::GetScrollY();
+        if (!cpu_running || y < top || y + line_h > top + ImGui::GetContentRegionAvail().y)
+            ImGui::SetScrollY(y);
+    }
+    if (cpu_running)
+        edit_addr = -1;
+    static const char hex[] = "0123456789ABCDEF";
+    ImDrawList *draw = ImGui::GetWindowDrawList();
+    ImU32 text_col = ImGui::GetColorU32(ImGuiCol_Text);
+    ImU32 hl_col[3] = {ImGui::GetColorU32(IMGRN), ImGui::GetColorU32(IMYLW), ImGui::GetColorU32(IMRED)};
+    unsigned hl_addr[3] = {regs.pc, regs.instr_ptr, regs.infer_addr}; // PC, instruction, inferred address
+    bool clicked = !cpu_running && ImGui::IsWindowHovered() && ImGui::IsMouseClicked(0);
+    ImVec2 mouse = ImGui::GetMousePos();
+    bool edit_shown = false;
+    ImGuiListClipper clipper;
+    clipper.Begin(nrows, line_h);
+    while (clipper.Step())
+    {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
         {
-            word pcaddr = cpu->pc;           // : 0x0;
-            word instraddr = cpu->instr_ptr; // : 0x0;
-            word tmpaddr = cpu->infer_addr;
-            if (j < 0) // address
+            // rows are formatted into one string each, again only when their
+            // pages were stamped since, also while the row was scrolled away
+            ImVec2 pos = ImGui::GetCursorScreenPos();
+            unsigned base = row * cols;
+            unsigned last = base + cols <= MAX_MEM_SZ ? base + cols - 1 : MAX_MEM_SZ - 1;
+            uint64_t gen = gui_mem.page[base >> 8];
+            uint64_t gen_last = gui_mem.page[last >> 8];
+            if (gen_last > gen)
+                gen = gen_last;
+            mem_view_row_t *cached = &mem_view_rows[row & (MEM_VIEW_CACHE - 1)];
+            if (cached->row != row || cached->cols != cols || cached->gen != gen)
             {
-                if (i == 0) // selectable base address
+                char *text = cached->text;
+                n = snprintf(text, sizeof(cached->text), "0x%04X  ", base);
+                for (int j = 0; j < cols; j++, n += 3)
                 {
-                    if (!cpu_running)
-                    {
-                        char tmp[10];
-                        snprintf(tmp, sizeof(tmp), "0x%04X", baddr);
-                        ImGui::PushStyleColor(0, IMCYN);
-                        if (ImGui::SelectableInput("baddr", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
-                        {
-                            unsigned short num = strtol(tmp, NULL, 16);
-                            if (num + rc[0] * rc[1] > (int)MAX_MEM_SZ)
-                                num = MAX_MEM_SZ - rc[0] * rc[1];
-                            baddr = num;
-                        }
-                        float scr = 0.0f;
-                        if ((scr = ImGui::GetIO().MouseWheel) != 0.0) // scroll detected!
-                        {
-                            // scroll max by 1 page
-                            baddr &= 0xff00;
-                            baddr += 0xff * (scr);
-                            if (baddr + rc[0] * rc[1] > (int)MAX_MEM_SZ)
-                                baddr = MAX_MEM_SZ - rc[0] * rc[1];
-                            if (baddr < 0)
-                                baddr = 0;
-                        }
-                        ImGui::PopStyleColor();
-                    }
-                    else
+                    text[n + 2] = ' ';
+                    if (base + j > last)
                     {
-                        // calculate base address so that current PC falls under a "page"
-                        word tmp_base = pcaddr & 0xff00; // max page
-                        while (pcaddr > tmp_base + rc[0] * rc[1])
-                            tmp_base += rc[0] + rc[1];
-                        baddr = tmp_base;
-                        // move to that base address
-                        char tmp[10];
-                        snprintf(tmp, sizeof(tmp), "0x%04X", baddr);
-                        ImGui::SelectableInput("baddr", false, ImGuiSelectableFlags_Disabled, tmp, IM_ARRAYSIZE(tmp));
+                        text[n] = text[n + 1] = ' ';
+                        continue;
                     }
-                    ImGui::NextColumn();
+                    byte val = gui_mem.mem[base + j];
+                    text[n] = hex[val >> 4];
+                    text[n + 1] = hex[val & 0xf];
                 }
-                else
+                text[n++] = ' ';
+                for (unsigned addr = base; addr <= last; addr++)
                 {
-                    ImGui::Text("0x%04X", baddr + rc[1] * i);
-                    ImGui::NextColumn();
+                    byte val = gui_mem.mem[addr];
+                    text[n++] = val >= 0x20 && val < 0x7f ? val : '.';
                 }
+                cached->row = row;
+                cached->cols = cols;
+                cached->gen = gen;
+                cached->n = n;
             }
-            else
+            n = cached->n;
+            memcpy(line, cached->text, n);
+            // blank the byte being edited and the highlighted bytes, which are
+            // drawn in their own color on top
+            int hl_col_idx[3];
+            int nhl = 0;
+            for (int k = -1; k < 3; k++)
             {
-                char label[32];
-                snprintf(label, 32, "mem_%d_%d", i, j);
-                char tmp[10];
-                int local_mem_idx = baddr + rc[1] * i + j;
-                snprintf(tmp, sizeof(tmp), "%02X", cpu->mem[local_mem_idx]);
-                bool colorpushed = false;
-                if (local_mem_idx == pcaddr)
-                {
-                    ImGui::PushStyleColor(0, IMGRN);
-                    colorpushed = true;
-                }
-                else if (local_mem_idx == instraddr)
+                unsigned addr = k < 0 ? (unsigned)edit_addr : hl_addr[k];
+                if (addr < base || addr > last)
+                    continue;
+                char *cell = &line[MEM_VIEW_ADDR_CHARS + 3 * (addr - base)];
+                if (cell[0] == ' ') // already taken
+                    continue;
+                cell[0] = cell[1] = ' ';
+                if (k >= 0)
+                    hl_col_idx[nhl++] = (addr - base) | (k << 8);
+            }
+            draw->AddText(pos, text_col, line, line + n);
+            for (int h = 0; h < nhl; h++)
+            {
+                int j = hl_col_idx[h] & 0xff;
+                byte val = gui_mem.mem[base + j];
+                char cell[2] = {hex[val >> 4], hex[val & 0xf]};
+                draw->AddText(ImVec2(pos.x + (MEM_VIEW_ADDR_CHARS + 3 * j) * char_w, pos.y), hl_col[hl_col_idx[h] >> 8], cell, cell + 2);
+            }
+            if (clicked && mouse.y >= pos.y && mouse.y < pos.y + line_h)
+            {
+                int c = (int)((mouse.x - pos.x) / char_w) - MEM_VIEW_ADDR_CHARS;
+                if (c >= 0 && c % 3 != 2 && c / 3 < cols && base + c / 3 < MAX_MEM_SZ)
                 {
-                    ImGui::PushStyleColor(0, IMYLW);
-                    colorpushed = true;
+                    edit_addr = base + c / 3;
+                    edit_focus = true;
+                    snprintf(edit_buf, sizeof(edit_buf), "%02X", gui_mem.mem[edit_addr]);
                 }
-                else if (local_mem_idx == tmpaddr)
+            }
+            if (edit_addr >= (int)base && edit_addr < (int)base + cols)
+            {
+                // the only widget in the view: an input over the byte being edited
+                edit_shown = true;
+                ImGui::SetCursorScreenPos(ImVec2(pos.x + (MEM_VIEW_ADDR_CHARS + 3 * (edit_addr - base)) * char_w, pos.y));
+                ImGui::PushItemWidth(3 * char_w);
+                if (edit_focus)
                 {
-                    ImGui::PushStyleColor(0, IMRED);
-                    colorpushed = true;
+                    ImGui::SetKeyboardFocusHere();
+                    edit_focus = false;
                 }
-                if (!cpu_running)
+                if (ImGui::InputText("##memedit", edit_buf, IM_ARRAYSIZE(edit_buf), ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_AutoSelectAll))
                 {
-                    if (ImGui::SelectableInput(label, false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)))
-                    {
-                        unsigned short num = strtol(tmp, NULL, 16);
-                        if (num > 0xff)
-                            num = 0;
-                        cpu->mem[local_mem_idx] = num;
-                    }
+                    GUICommand(CMD_WRITE_MEM, edit_addr, strtol(edit_buf, NULL, 16) & 0xff);
+                    // continue with the next byte
+                    edit_addr = edit_addr + 1 < (int)MAX_MEM_SZ ? edit_addr + 1 : -1;
+                    if (edit_addr >= 0)
+                        snprintf(edit_buf, sizeof(edit_buf), "%02X", gui_mem.mem[edit_addr]);
+                    edit_focus = true;
                 }
-                else
+                else if (ImGui::IsItemDeactivated())
+                    edit_addr = -1;
+                ImGui::PopItemWidth();
+                ImGui::SetCursorScreenPos(pos);
+            }
+            ImGui::Dummy(ImVec2(n * char_w, ImGui::GetTextLineHeight()));
+        }
+    }
+    clipper.End();
+    if (!edit_shown && !edit_focus)
+        edit_addr = -1;
+    ImGui::EndChild();
+    ImGui::PopFont();
+    ImGui::End();
+    usr_font_scale = __usr_font_scale;
+}
+
+void BreakpointWindow(bool *active)
+{
+    ImGui::Begin("Break Points", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static char addbuf[64] = "";
+    ImGui::Text("Add: ");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(8 * font_scale * FONT_SZ);
+    if (ImGui::InputText("##bpadd", addbuf, IM_ARRAYSIZE(addbuf), ImGuiInputTextFlags_EnterReturnsTrue))
+    {
+        unsigned num;
+        if (ParseAddress(addbuf, &num))
+            GUICommand(CMD_BREAK_SET, num, true);
+        addbuf[0] = '\0';
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Clear All"))
+        GUICommand(CMD_BREAK_CLEAR);
+    ImGui::Text("Enabled: %u", bp_count);
+    ImGui::Separator();
+    ImGui::Columns(3, "bplist", false);
+    ImGui::SetColumnWidth(0, 2 * font_scale * FONT_SZ);
+    ImGui::SetColumnWidth(1, 4 * font_scale * FONT_SZ);
+    for (int addr = CPUBreakNext(0); addr >= 0; addr = CPUBreakNext(addr + 1))
+    {
+        ImGui::PushID(addr);
+        bool enabled = bp_test(addr);
+        if (ImGui::Checkbox("##en", &enabled))
+            GUICommand(CMD_BREAK_SET, addr, enabled);
+        ImGui::NextColumn();
+        ImGui::PushFont(HexWinFont);
+        const char *name = SymbolAt(addr);
+        ImGui::TextColored(addr == (int)bp_hit ? IMGRN : ImGui::GetStyle().Colors[ImGuiCol_Text], "0x%04X %s", addr, name != NULL ? name : "");
+        ImGui::PopFont();
+        ImGui::NextColumn();
+        bool remove = ImGui::SmallButton("Remove");
+        ImGui::NextColumn();
+        ImGui::PopID();
+        if (remove)
+            GUICommand(CMD_BREAK_REMOVE, addr);
+    }
+    ImGui::Columns(1);
+    ImGui::End();
+}
+
+void WatchpointWindow(bool *active)
+{
+    ImGui::Begin("Watch Points", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static char startbuf[10] = "";
+    static char endbuf[10] = "";
+    static bool wr = false, ww = true, wx = false;
+    ImGui::PushItemWidth(4 * font_scale * FONT_SZ);
+    ImGui::Text("From: ");
+    ImGui::SameLine();
+    ImGui::InputText("##wpstart", startbuf, IM_ARRAYSIZE(startbuf), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::SameLine();
+    ImGui::Text("To: ");
+    ImGui::SameLine();
+    ImGui::InputText("##wpend", endbuf, IM_ARRAYSIZE(endbuf), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::PopItemWidth();
+    ImGui::Checkbox("Read", &wr);
+    ImGui::SameLine();
+    ImGui::Checkbox("Write", &ww);
+    ImGui::SameLine();
+    ImGui::Checkbox("Execute", &wx);
+    ImGui::SameLine();
+    if (ImGui::Button("Add") && startbuf[0] != '\0')
+    {
+        unsigned start = strtol(startbuf, NULL, 16);
+        unsigned end = endbuf[0] != '\0' ? strtol(endbuf, NULL, 16) : start;
+        uint8_t flags = (wr ? WP_READ : 0) | (ww ? WP_WRITE : 0) | (wx ? WP_EXEC : 0);
+        if (start <= end && end < MAX_MEM_SZ && flags)
+            GUICommand(CMD_WATCH_ADD, start, end | (flags << 16));
+        startbuf[0] = '\0';
+        endbuf[0] = '\0';
+    }
+    ImGui::Text("Armed: %u", wp_armed);
+    ImGui::Separator();
+    ImGui::Columns(4, "wplist", false);
+    ImGui::SetColumnWidth(0, 2 * font_scale * FONT_SZ);
+    ImGui::SetColumnWidth(1, 8 * font_scale * FONT_SZ);
+    ImGui::SetColumnWidth(2, 3 * font_scale * FONT_SZ);
+    for (int idx = 0; idx < WP_MAX; idx++)
+    {
+        if (!watchpoints[idx].used)
+            continue;
+        cpu_watch_t *wp = &watchpoints[idx];
+        ImGui::PushID(idx);
+        bool enabled = wp->enabled;
+        if (ImGui::Checkbox("##en", &enabled))
+            GUICommand(CMD_WATCH_SET, idx, enabled);
+        ImGui::NextColumn();
+        ImGui::PushFont(HexWinFont);
+        bool hit = wp_hit.hit && wp_hit.addr >= wp->start && wp_hit.addr <= wp->end;
+        if (wp->start == wp->end)
+            ImGui::TextColored(hit ? IMRED : ImGui::GetStyle().Colors[ImGuiCol_Text], "0x%04X", wp->start);
+        else
+            ImGui::TextColored(hit ? IMRED : ImGui::GetStyle().Colors[ImGuiCol_Text], "0x%04X-0x%04X", wp->start, wp->end);
+        ImGui::PopFont();
+        ImGui::NextColumn();
+        ImGui::Text("%c%c%c", wp->flags & WP_READ ? 'R' : '-', wp->flags & WP_WRITE ? 'W' : '-', wp->flags & WP_EXEC ? 'X' : '-');
+        ImGui::NextColumn();
+        bool remove = ImGui::SmallButton("Remove");
+        ImGui::NextColumn();
+        ImGui::PopID();
+        if (remove)
+            GUICommand(CMD_WATCH_REMOVE, idx);
+    }
+    ImGui::Columns(1);
+    // read-only memory, writes by the CPU are dropped
+    ImGui::Separator();
+    static char romstart[10] = "";
+    static char romend[10] = "";
+    ImGui::PushItemWidth(4 * font_scale * FONT_SZ);
+    ImGui::Text("ROM: ");
+    ImGui::SameLine();
+    ImGui::InputText("##romstart", romstart, IM_ARRAYSIZE(romstart), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::SameLine();
+    ImGui::Text("To: ");
+    ImGui::SameLine();
+    ImGui::InputText("##romend", romend, IM_ARRAYSIZE(romend), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Protect") && romstart[0] != '\0')
+    {
+        unsigned start = strtol(romstart, NULL, 16);
+        unsigned end = romend[0] != '\0' ? strtol(romend, NULL, 16) : start;
+        if (start <= end && end < MAX_MEM_SZ)
+            GUICommand(CMD_ROM_SET, start, end | (1 << 16));
+        romstart[0] = '\0';
+        romend[0] = '\0';
+    }
+    bool trap = bus_rom_trap;
+    if (ImGui::Checkbox("Stop on ROM Write", &trap))
+        GUICommand(CMD_ROM_TRAP, 0, trap);
+    ImGui::Columns(2, "romlist", false);
+    ImGui::SetColumnWidth(0, 10 * font_scale * FONT_SZ);
+    unsigned end;
+    for (unsigned start = BusRomNext(0, &end); start < MAX_MEM_SZ; start = BusRomNext(end + 1, &end))
+    {
+        ImGui::PushID(start);
+        ImGui::PushFont(HexWinFont);
+        bool hit = rom_hit.hit && rom_hit.addr >= start && rom_hit.addr <= end;
+        if (start == end)
+            ImGui::TextColored(hit ? IMRED : ImGui::GetStyle().Colors[ImGuiCol_Text], "0x%04X", start);
+        else
+            ImGui::TextColored(hit ? IMRED : ImGui::GetStyle().Colors[ImGuiCol_Text], "0x%04X-0x%04X", start, end);
+        ImGui::PopFont();
+        ImGui::NextColumn();
+        if (ImGui::SmallButton("Remove"))
+            GUICommand(CMD_ROM_SET, start, end);
+        ImGui::NextColumn();
+        ImGui::PopID();
+    }
+    ImGui::Columns(1);
+    ImGui::End();
+}
+
+void TraceWindow(bool *active)
+{
+    ImGui::Begin("Trace", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static bool follow = true;
+    bool _trace_enabled = trace_enabled.load(std::memory_order_relaxed);
+    if (ImGui::Checkbox("Record", &_trace_enabled))
+        GUICommand(CMD_TRACE_ENABLE, 0, _trace_enabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Follow", &follow);
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+        GUICommand(CMD_TRACE_CLEAR);
+    static char trace_fname[256] = "trace.bin";
+    bool _trace_file = trace_file_active;
+    if (ImGui::Checkbox("Write to File", &_trace_file))
+    {
+        if (_trace_file)
+            TraceFileStart(trace_fname);
+        else
+            TraceFileStop();
+    }
+    ImGui::SameLine();
+    ImGui::PushItemWidth(16 * font_scale * FONT_SZ);
+    ImGui::InputText("##tracefile", trace_fname, IM_ARRAYSIZE(trace_fname));
+    ImGui::PopItemWidth();
+    if (trace_file_active)
+    {
+        ImGui::SameLine();
+        ImGui::Text("%.1f MiB", trace_file_count * sizeof(trace_entry_t) / 1048576.0);
+    }
+    // the range is fixed for this frame, entries keep being added behind it
+    uint64_t end = trace_pos.load(std::memory_order_acquire);
+    uint64_t first = TraceFirst(end);
+    ImGui::SameLine();
+    ImGui::Text("Instructions: %llu", (unsigned long long)(end - first));
+    ImGui::Separator();
+    ImGui::PushFont(HexWinFont);
+    ImGui::Text("%12s  %4s  %-6s  %-5s  %s", "Cycle", "PC", "Opcode", "EA", "Registers");
+    ImGui::BeginChild("tracelines");
+    ImGuiListClipper clipper;
+    clipper.Begin((int)(end - first));
+    char line[TRACE_LINE_SZ];
+    while (clipper.Step())
+    {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+        {
+            trace_entry_t ent;
+            if (!TraceRead(first + i, &ent))
+            {
+                ImGui::TextUnformatted("(overwritten)");
+                continue;
+            }
+            TraceFormat(&ent, line, sizeof(line));
+            const char *name = SymbolAt(TRACE_PC(&ent));
+            if (name != NULL)
+                ImGui::Text("%s  %s", line, name);
+            else
+                ImGui::TextUnformatted(line);
+        }
+    }
+    clipper.End();
+    if (follow && cpu_running)
+        ImGui::SetScrollHereY(1.0f);
+    ImGui::EndChild();
+    ImGui::PopFont();
+    ImGui::End();
+}
+
+#define PROF_TOP_N 64 // addresses shown in the profiler window
+
+static uint64_t prof_view_pc_count[MAX_MEM_SZ]; // counters as of the last profiler snapshot
+static uint64_t prof_view_pc_cycles[MAX_MEM_SZ];
+static uint64_t prof_view_op_count[256];
+static uint64_t prof_view_op_cycles[256];
+
+static int ProfileCompareAddr(const void *a, const void *b)
+{
+    uint64_t ca = prof_view_pc_cycles[*(const unsigned *)a], cb = prof_view_pc_cycles[*(const unsigned *)b];
+    return ca < cb ? 1 : (ca > cb ? -1 : 0);
+}
+
+static int ProfileCompareOp(const void *a, const void *b)
+{
+    uint64_t ca = prof_view_op_cycles[*(const unsigned *)a], cb = prof_view_op_cycles[*(const unsigned *)b];
+    return ca < cb ? 1 : (ca > cb ? -1 : 0);
+}
+
+void ProfilerWindow(bool *active)
+{
+    ImGui::Begin("Profiler", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static unsigned addrs[MAX_MEM_SZ]; // addresses by cycles, descending
+    static unsigned naddrs = 0;
+    static unsigned ops[256]; // opcodes by cycles, descending
+    static unsigned nops = 0;
+    static uint64_t total = 0;
+    static bool autorefresh = true;
+    static double last_refresh = 0;
+    bool _prof_enabled = prof_enabled;
+    if (ImGui::Checkbox("Enable", &_prof_enabled))
+        GUICommand(CMD_PROF_ENABLE, 0, _prof_enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+        GUICommand(CMD_PROF_RESET);
+    ImGui::SameLine();
+    bool refresh = ImGui::Button("Snapshot");
+    ImGui::SameLine();
+    ImGui::Checkbox("Auto", &autorefresh);
+    if (autorefresh && prof_enabled && ImGui::GetTime() - last_refresh > 0.5)
+        refresh = true;
+    if (refresh)
+    {
+        // sort a copy, the counters keep changing while the CPU runs
+        last_refresh = ImGui::GetTime();
+        memcpy(prof_view_pc_count, prof_pc_count, sizeof(prof_pc_count));
+        memcpy(prof_view_pc_cycles, prof_pc_cycles, sizeof(prof_pc_cycles));
+        memcpy(prof_view_op_count, prof_op_count, sizeof(prof_op_count));
+        memcpy(prof_view_op_cycles, prof_op_cycles, sizeof(prof_op_cycles));
+        total = 0;
+        naddrs = 0;
+        for (unsigned i = 0; i < MAX_MEM_SZ; i++)
+        {
+            if (!prof_view_pc_count[i])
+                continue;
+            addrs[naddrs++] = i;
+            total += prof_view_pc_cycles[i];
+        }
+        qsort(addrs, naddrs, sizeof(unsigned), ProfileCompareAddr);
+        nops = 0;
+        for (unsigned i = 0; i < 256; i++)
+            if (prof_view_op_count[i])
+                ops[nops++] = i;
+        qsort(ops, nops, sizeof(unsigned), ProfileCompareOp);
+    }
+    ImGui::Text("Cycles profiled: %llu", (unsigned long long)total);
+    ImGui::Separator();
+    ImGui::Text("Hottest addresses");
+    ImGui::PushFont(HexWinFont);
+    ImGui::Columns(4, "profaddr", false);
+    ImGui::Text("Address");
+    ImGui::NextColumn();
+    ImGui::Text("Count");
+    ImGui::NextColumn();
+    ImGui::Text("Cycles");
+    ImGui::NextColumn();
+    ImGui::Text("%%");
+    ImGui::NextColumn();
+    for (unsigned i = 0; i < naddrs && i < PROF_TOP_N; i++)
+    {
+        unsigned addr = addrs[i];
+        unsigned offset;
+        const char *name = SymbolNear(addr, SYM_NEAR_MAX, &offset);
+        if (name == NULL)
+            ImGui::Text("0x%04X", addr);
+        else if (offset)
+            ImGui::Text("0x%04X %s+%u", addr, name, offset);
+        else
+            ImGui::Text("0x%04X %s", addr, name);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)prof_view_pc_count[addr]);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)prof_view_pc_cycles[addr]);
+        ImGui::NextColumn();
+        ImGui::Text("%.2f", total ? 100.0 * prof_view_pc_cycles[addr] / total : 0);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::PopFont();
+    ImGui::Separator();
+    ImGui::Text("Opcodes");
+    ImGui::PushFont(HexWinFont);
+    ImGui::Columns(5, "profop", false);
+    ImGui::Text("Opcode");
+    ImGui::NextColumn();
+    ImGui::Text("Count");
+    ImGui::NextColumn();
+    ImGui::Text("Cycles");
+    ImGui::NextColumn();
+    ImGui::Text("Avg");
+    ImGui::NextColumn();
+    ImGui::Text("%%");
+    ImGui::NextColumn();
+    for (unsigned i = 0; i < nops; i++)
+    {
+        unsigned op = ops[i];
+        ImGui::Text("%02X %s", op, OPCODE_INFO[op].name);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)prof_view_op_count[op]);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)prof_view_op_cycles[op]);
+        ImGui::NextColumn();
+        ImGui::Text("%.2f", (double)prof_view_op_cycles[op] / prof_view_op_count[op]);
+        ImGui::NextColumn();
+        ImGui::Text("%.2f", total ? 100.0 * prof_view_op_cycles[op] / total : 0);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::PopFont();
+    ImGui::End();
+}
+
+#define HEAT_SIDE 256      // heatmap texture is HEAT_SIDE x HEAT_SIDE, one texel per address
+#define HEAT_LOG_MAX 16.0f // log2 of the decayed access count shown at full brightness
+
+static float heat_level[3][MAX_MEM_SZ];    // decayed access counts: read, write, execute
+static uint32_t heat_last[3][MAX_MEM_SZ];  // counters at the last frame
+static byte heat_pixels[MAX_MEM_SZ * 4];   // RGBA texels
+static GLuint heat_tex = 0;
+static uint64_t heat_seen = 0;             // heat_dirty generation at the last frame
+static uint64_t heat_lit[DIRTY_WORDS];     // pages with texels that are not black yet
+
+void HeatmapWindow(bool *active)
+{
+    ImGui::Begin("Heatmap", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static float half_life = 1.0f; // seconds
+    static int zoom = 2;
+    static double last_time = 0;
+    bool _heat_enabled = heat_enabled;
+    if (ImGui::Checkbox("Enable", &_heat_enabled))
+    {
+        if (_heat_enabled) // do not show the accesses counted while disabled
+        {
+            memcpy(heat_last[0], heat_read, sizeof(heat_read));
+            memcpy(heat_last[1], heat_write, sizeof(heat_write));
+            memcpy(heat_last[2], heat_exec, sizeof(heat_exec));
+        }
+        GUICommand(CMD_HEAT_ENABLE, 0, _heat_enabled);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+        memset(heat_level, 0, sizeof(heat_level));
+    ImGui::SameLine();
+    ImGui::PushItemWidth(100);
+    ImGui::SliderFloat("Half-life (s)", &half_life, 0.1f, 10.0f, "%.1f");
+    ImGui::SameLine();
+    ImGui::SliderInt("Zoom", &zoom, 1, 4);
+    ImGui::PopItemWidth();
+    ImGui::TextColored(IMRED, "Write");
+    ImGui::SameLine();
+    ImGui::TextColored(ImVec4(0, 1, 0, 1), "Read");
+    ImGui::SameLine();
+    ImGui::TextColored(ImVec4(0.3, 0.5, 1, 1), "Execute");
+    ImGui::SameLine();
+    ImGui::Text("\tRow: page, column: offset in page");
+
+    // decay the levels by the time since the last frame, add the new accesses
+    // and convert them to texels, in one pass over the pages that were accessed
+    // or are still lit, the others are black already
+    double now = ImGui::GetTime();
+    float decay = last_time > 0 ? powf(0.5f, (float)(now - last_time) / half_life) : 0;
+    last_time = now;
+    const uint32_t *counts[3] = {heat_read, heat_write, heat_exec};
+    uint64_t pages[DIRTY_WORDS];
+    DirtyTake(&heat_dirty, &heat_seen, pages);
+    for (unsigned page = 0; page < DIRTY_PAGES; page++)
+    {
+        if (heat_tex != 0 && !DirtyTest(pages, page) && !DirtyTest(heat_lit, page))
+            continue;
+        bool lit = false;
+        for (unsigned i = page << 8; i < (page + 1) << 8; i++)
+        {
+            byte ch[3];
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t cnt = counts[k][i];
+                float level = heat_level[k][i] * decay + (uint32_t)(cnt - heat_last[k][i]);
+                heat_last[k][i] = cnt;
+                heat_level[k][i] = level;
+                float v = level > 0 ? log2f(1 + level) / HEAT_LOG_MAX : 0;
+                ch[k] = v >= 1 ? 255 : (byte)(v * 255);
+                lit |= ch[k] != 0;
+            }
+            byte *px = &heat_pixels[i * 4];
+            px[0] = ch[1]; // red: write
+            px[1] = ch[0]; // green: read
+            px[2] = ch[2]; // blue: execute
+            px[3] = 255;
+        }
+        if (lit)
+            heat_lit[page >> 6] |= 1ULL << (page & 63);
+        else
+            heat_lit[page >> 6] &= ~(1ULL << (page & 63));
+    }
+    if (heat_tex == 0)
+    {
+        glGenTextures(1, &heat_tex);
+        glBindTexture(GL_TEXTURE_2D, heat_tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, HEAT_SIDE, HEAT_SIDE, 0, GL_RGBA, GL_UNSIGNED_BYTE, heat_pixels);
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, heat_tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, HEAT_SIDE, HEAT_SIDE, GL_RGBA, GL_UNSIGNED_BYTE, heat_pixels);
+    }
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float side = HEAT_SIDE * zoom;
+    ImGui::Image((ImTextureID)(intptr_t)heat_tex, ImVec2(side, side));
+    if (ImGui::IsItemHovered())
+    {
+        ImVec2 mouse = ImGui::GetMousePos();
+        int col = (int)((mouse.x - origin.x) / zoom);
+        int row = (int)((mouse.y - origin.y) / zoom);
+        if (col >= 0 && col < HEAT_SIDE && row >= 0 && row < HEAT_SIDE)
+        {
+            unsigned addr = row * HEAT_SIDE + col;
+            ImGui::SetTooltip("0x%04X: R %u  W %u  X %u", addr, heat_read[addr], heat_write[addr], heat_exec[addr]);
+        }
+    }
+    ImGui::End();
+}
+
+#define DISASM_CONTEXT 6     // instructions shown above the current one
+#define DISASM_MAX_LINES 128 // max lines in the disassembly window
+#define DISASM_WHEEL_LINES 3 // instructions scrolled per mouse wheel step
+
+void DisassemblyWindow(bool *active)
+{
+    ImGui::Begin("Disassembly", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static bool follow = true;
+    static unsigned top = DEFAULT_RST;         // first address shown
+    static unsigned shown[DISASM_MAX_LINES];   // addresses shown in the last frame
+    static unsigned nshown = 0;
+    cpu_snapshot_t regs;
+    CPUSnapshot(&regs, &gui_mem);
+    ImGui::Checkbox("Follow PC", &follow);
+    ImGui::SameLine();
+    ImGui::Text("Go to: ");
+    ImGui::SameLine();
+    char tmp[64] = "";
+    unsigned goto_addr;
+    ImGui::PushStyleColor(0, IMCYN);
+    if (ImGui::SelectableInput("disasmaddr", false, ImGuiSelectableFlags_None, tmp, IM_ARRAYSIZE(tmp)) && ParseAddress(tmp, &goto_addr))
+    {
+        top = goto_addr;
+        follow = false;
+    }
+    ImGui::PopStyleColor();
+    ImGui::SameLine();
+    ImGui::Text("\tClick a line to toggle its break point");
+    ImGui::Separator();
+    ImGui::PushFont(HexWinFont);
+    ImGui::BeginChild("disasmlines");
+    if (follow)
+    {
+        // keep the view still while the instruction is in it, so that running
+        // at full speed mostly hits the decode cache
+        bool in_view = false;
+        for (unsigned i = 0; i + 1 < nshown && !in_view; i++)
+            in_view = shown[i] == regs.instr_ptr;
+        if (!in_view)
+            top = DisasmBack(gui_mem.mem, regs.instr_ptr, DISASM_CONTEXT);
+    }
+    float wheel = ImGui::IsWindowHovered() ? ImGui::GetIO().MouseWheel : 0;
+    if (wheel < 0)
+    {
+        for (int i = 0; i < DISASM_WHEEL_LINES && top + DisasmLookup(gui_mem.mem, top)->len < MAX_MEM_SZ; i++)
+            top += DisasmLookup(gui_mem.mem, top)->len;
+        follow = false;
+    }
+    else if (wheel > 0)
+    {
+        top = DisasmBack(gui_mem.mem, top, DISASM_WHEEL_LINES);
+        follow = false;
+    }
+    unsigned nlines = ImGui::GetContentRegionAvail().y / ImGui::GetTextLineHeightWithSpacing();
+    if (nlines > DISASM_MAX_LINES)
+        nlines = DISASM_MAX_LINES;
+    nshown = 0;
+    char line[96];
+    for (unsigned addr = top, rows = 0; rows < nlines && addr < MAX_MEM_SZ; rows++)
+    {
+        // symbols take a line of their own above the instruction
+        const char *name = SymbolAt(addr);
+        if (name != NULL && rows + 1 < nlines)
+        {
+            ImGui::TextColored(IMCYN, "%s:", name);
+            rows++;
+        }
+        const disasm_entry_t *ent = DisasmLookup(gui_mem.mem, addr);
+        char bytes[10] = "";
+        for (unsigned k = 0, n = 0; k < ent->len; k++)
+            n += snprintf(bytes + n, sizeof(bytes) - n, "%02X ", ent->bytes[k]);
+        bool bp = CPUBreakIsSet(addr);
+        bool current = addr == regs.instr_ptr;
+        snprintf(line, sizeof(line), "%c%c %04X  %-9s %s##%04X", current ? '>' : ' ', bp ? '*' : ' ', addr, bytes, ent->text, addr);
+        if (current)
+            ImGui::PushStyleColor(0, IMYLW);
+        else if (bp)
+            ImGui::PushStyleColor(0, IMRED);
+        if (ImGui::Selectable(line, current))
+        {
+            if (bp)
+                GUICommand(CMD_BREAK_REMOVE, addr);
+            else
+                GUICommand(CMD_BREAK_SET, addr, true);
+        }
+        if (current || bp)
+            ImGui::PopStyleColor();
+        shown[nshown++] = addr;
+        addr += ent->len;
+    }
+    ImGui::EndChild();
+    ImGui::PopFont();
+    ImGui::End();
+}
+
+// Write the assembled bytes that differ from memory, one command per run of
+// assembled bytes holding a change. Returns false if the queue is full.
+// Write the assembled bytes that changed since the last call into memory.
+// Returns false if they could not all be queued, the rest stay marked.
+static bool AsmWriteChanges(asm_t *as)
+{
+    for (unsigned w = 0; w < MAX_MEM_SZ / 64; w++)
+    {
+        while (as->changed[w])
+        {
+            unsigned addr = (w << 6) + __builtin_ctzll(as->changed[w]);
+            // the run of changed addresses that hold assembled bytes
+            unsigned end = addr;
+            while (end < MAX_MEM_SZ && ((as->changed[end >> 6] >> (end & 63)) & 1) && AsmUsed(as, end))
+                end++;
+            if (end == addr) // dropped, memory keeps what it holds
+            {
+                as->changed[w] &= as->changed[w] - 1;
+                continue;
+            }
+            unsigned first = addr, last = addr;
+            for (unsigned a = addr; a < end; a++)
+            {
+                if (as->image[a] == cpu->mem[a])
+                    continue;
+                if (last == first)
+                    first = a;
+                last = a + 1;
+            }
+            if (last > first)
+            {
+                byte *data = (byte *)malloc(last - first);
+                if (data == NULL)
+                    return false;
+                memcpy(data, &as->image[first], last - first);
+                if (!CPUCommand(CMD_WRITE_BLOCK, first, last - first, data))
                 {
-                    ImGui::SelectableInput(label, false, ImGuiSelectableFlags_Disabled, tmp, IM_ARRAYSIZE(tmp));
+                    free(data);
+                    return false;
                 }
-                if (colorpushed)
-                    ImGui::PopStyleColor();
-                ImGui::NextColumn();
             }
+            for (unsigned a = addr; a < end; a++)
+                as->changed[a >> 6] &= ~(1ULL << (a & 63));
         }
     }
-    ImGui::Columns(1);
+    return true;
+}
+
+void AssemblerWindow(bool *active)
+{
+    ImGui::Begin("Assembler", active);
+    static float font_scale = 1.0f / FONT_SCALE;
+    ImGui::SetWindowFontScale(font_scale);
+    static bool autoasm = true;
+    static double asm_ms = 0;
+    bool assemble = ImGui::Button("Assemble");
+    ImGui::SameLine();
+    ImGui::Checkbox("Auto", &autoasm);
+    ImGui::SameLine();
+    if (asm_state.nerrors)
+        ImGui::TextColored(IMRED, "\t%u errors", asm_state.nerrors);
+    else
+        ImGui::Text("\t%u bytes from 0x%04X, %u lines (%u parsed, %u emitted) in %.2f ms", asm_state.bytes, asm_state.start < 0 ? 0 : asm_state.start, asm_state.nlines, asm_state.parsed, asm_state.emitted, asm_ms);
+    for (unsigned i = 0; i < asm_state.nerrors && i < ASM_MAX_ERRORS; i++)
+        ImGui::TextColored(IMRED, "Line %u: %s", asm_state.errors[i].line, asm_state.errors[i].msg);
+    ImGui::PushFont(HexWinFont);
+    if (ImGui::InputTextMultiline("##asmsrc", asm_src, sizeof(asm_src), ImVec2(-1, -1), ImGuiInputTextFlags_AllowTabInput) && autoasm)
+        assemble = true;
     ImGui::PopFont();
+    if (assemble)
+    {
+        uint64_t start = get_monotonic_ns();
+        // only write complete results, partial ones could clobber memory
+        asm_pending = AsmAssemble(&asm_state, asm_src);
+        asm_ms = (get_monotonic_ns() - start) * 1e-6;
+    }
     ImGui::End();
-    usr_font_scale = __usr_font_scale;
 }
 
 void GUISettings(bool *active)
@@ -895,5 +1836,24 @@ void HelpWindow(bool *active)
     ImGui::Text("MOS6502 Emulator");
     ImGui::Separator();
     ImGui::Text("Reset CPU: Load current value of reset vector (default: 0x8000) to program counter (PC), clear all registers, and set the CPU into stepping mode.");
+    ImGui::Text("Batched: Run all cycles due since the last clock tick at once, with a %.0f us tick instead of one tick per cycle.", CPU_BATCH_TICK_NS * 1e-3);
+    ImGui::Text("Detect Traps: Stop when an instruction branches or jumps to itself, and report whether it is the success trap (default: 0x%04X).", FUNC_TEST_SUCCESS);
+    ImGui::Text("Step: Execute a single clock cycle. Step Instr: Run to the start of the next instruction.");
+    ImGui::Text("Step Over: Like Step Instr, but run a subroutine called with JSR to its return. Step Out: Run until the current subroutine returns.");
+    ImGui::Text("Rewind: Keep a history of the last instructions and the memory they changed in at most the given memory, about %u bytes each. Values read from devices come back, the devices themselves are not rewound. Step Back: Go back to the previous instruction. Run Back: Go back to the last break point hit.", (unsigned)sizeof(rewind_entry_t));
+    ImGui::Text("Trace: Record the registers and effective address of the last %d instructions executed, on from the start. Uncheck Record to run without it.", TRACE_RING_SZ);
+    ImGui::Text("Write to File: Stream every recorded instruction to the file. The CPU waits for the writer thread if it falls behind, so no entry is lost.");
+    ImGui::Text("Profile: Count executions and cycles per instruction address and per opcode, shown sorted by cycles in the Profiler window.");
+    ImGui::Text("Load Custom: Load a raw binary at the base address, an Intel HEX, S-record or C64 PRG file, detected by its content. The file is read in the background, then only the addresses in it change and the CPU resets to its start address.");
+    ImGui::Text("Save State: Write the registers, memory, break points, frequency and cycle count to the slot's file, slotN.state. Load State: Restore them and stop in stepping mode.");
+    ImGui::Text("Record: Save a compact state to " RECORD_FILE " every %d cycles while running, only the memory changed since the last load is stored. Restore: Go back to the selected state.", RECORD_INTERVAL_DEFAULT);
+    ImGui::Text("Memory Editor: Scroll through all 64 KiB, or type an address in Go to. Click a byte to edit it while paused, Enter writes it and moves to the next byte.");
+    ImGui::Text("Assembler: Assemble the source into memory, with labels, expressions and .org, .byte, .word, .res and = directives. Auto assembles on every edit, only the changed lines are parsed again, and only they and the lines they move or whose symbols change are emitted again.");
+    ImGui::Text("Disassembly: Follow the current instruction or go to an address, scroll with the mouse wheel, and click a line to toggle its break point.");
+    ImGui::Text("Symbols: Load ld65 .dbg, VICE label or \"name = $addr\" files to name addresses in the disassembly, trace, profiler and break points. Go to, break point, vector and success trap fields accept symbol names.");
+    ImGui::Text("Heatmap: Show how often each address was recently read, written or executed, one pixel per address with 0x0000 at the top left.");
+    ImGui::Text("Watch Points: Stop before an instruction reads, writes or executes an address in a watched range.");
+    ImGui::Text("ROM: Make a range read-only, the CPU's writes to it are dropped while the editor and loaders can still change it. Stop on ROM Write stops before the writing instruction.");
+    ImGui::Text("Turbo: Run the CPU as fast as possible on its own thread, ignoring the set frequency, and show the achieved speed.");
     ImGui::End();
 }
\ No newline at end of file
@@ -0,0 +1,396 @@
+#include "opcodes.h"
+#include <stdio.h>
+
+const opcode_info_t OPCODE_INFO[256] = {
+    {"BRK", AM_IMP, OP_WRITE | OP_STACK(3), 7}, // 0x00
+    {"ORA", AM_INDX, OP_READ, 6}, // 0x01
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x02
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x03
+    {"???", AM_IMP, OP_ILLEGAL, 3}, // 0x04
+    {"ORA", AM_ZP, OP_READ, 3}, // 0x05
+    {"ASL", AM_ZP, OP_READ | OP_WRITE, 5}, // 0x06
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x07
+    {"PHP", AM_IMP, OP_WRITE | OP_STACK(1), 3}, // 0x08
+    {"ORA", AM_IMM, 0, 2}, // 0x09
+    {"ASL", AM_ACC, 0, 2}, // 0x0A
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x0B
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x0C
+    {"ORA", AM_ABS, OP_READ, 4}, // 0x0D
+    {"ASL", AM_ABS, OP_READ | OP_WRITE, 6}, // 0x0E
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x0F
+    {"BPL", AM_REL, 0, 2}, // 0x10
+    {"ORA", AM_INDY, OP_READ, 5}, // 0x11
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x12
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x13
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x14
+    {"ORA", AM_ZPX, OP_READ, 4}, // 0x15
+    {"ASL", AM_ZPX, OP_READ | OP_WRITE, 6}, // 0x16
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x17
+    {"CLC", AM_IMP, 0, 2}, // 0x18
+    {"ORA", AM_ABSY, OP_READ, 4}, // 0x19
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x1A
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x1B
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x1C
+    {"ORA", AM_ABSX, OP_READ, 4}, // 0x1D
+    {"ASL", AM_ABSX, OP_READ | OP_WRITE, 7}, // 0x1E
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x1F
+    {"JSR", AM_ABS, OP_WRITE | OP_STACK(2), 6}, // 0x20
+    {"AND", AM_INDX, OP_READ, 6}, // 0x21
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x22
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x23
+    {"BIT", AM_ZP, OP_READ, 3}, // 0x24
+    {"AND", AM_ZP, OP_READ, 3}, // 0x25
+    {"ROL", AM_ZP, OP_READ | OP_WRITE, 5}, // 0x26
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x27
+    {"PLP", AM_IMP, OP_READ | OP_STACK(1), 4}, // 0x28
+    {"AND", AM_IMM, 0, 2}, // 0x29
+    {"ROL", AM_ACC, 0, 2}, // 0x2A
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x2B
+    {"BIT", AM_ABS, OP_READ, 4}, // 0x2C
+    {"AND", AM_ABS, OP_READ, 4}, // 0x2D
+    {"ROL", AM_ABS, OP_READ | OP_WRITE, 6}, // 0x2E
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x2F
+    {"BMI", AM_REL, 0, 2}, // 0x30
+    {"AND", AM_INDY, OP_READ, 5}, // 0x31
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x32
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x33
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x34
+    {"AND", AM_ZPX, OP_READ, 4}, // 0x35
+    {"ROL", AM_ZPX, OP_READ | OP_WRITE, 6}, // 0x36
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x37
+    {"SEC", AM_IMP, 0, 2}, // 0x38
+    {"AND", AM_ABSY, OP_READ, 4}, // 0x39
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x3A
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x3B
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x3C
+    {"AND", AM_ABSX, OP_READ, 4}, // 0x3D
+    {"ROL", AM_ABSX, OP_READ | OP_WRITE, 7}, // 0x3E
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x3F
+    {"RTI", AM_IMP, OP_READ | OP_STACK(3), 6}, // 0x40
+    {"EOR", AM_INDX, OP_READ, 6}, // 0x41
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x42
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x43
+    {"???", AM_IMP, OP_ILLEGAL, 3}, // 0x44
+    {"EOR", AM_ZP, OP_READ, 3}, // 0x45
+    {"LSR", AM_ZP, OP_READ | OP_WRITE, 5}, // 0x46
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x47
+    {"PHA", AM_IMP, OP_WRITE | OP_STACK(1), 3}, // 0x48
+    {"EOR", AM_IMM, 0, 2}, // 0x49
+    {"LSR", AM_ACC, 0, 2}, // 0x4A
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x4B
+    {"JMP", AM_ABS, 0, 3}, // 0x4C
+    {"EOR", AM_ABS, OP_READ, 4}, // 0x4D
+    {"LSR", AM_ABS, OP_READ | OP_WRITE, 6}, // 0x4E
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x4F
+    {"BVC", AM_REL, 0, 2}, // 0x50
+    {"EOR", AM_INDY, OP_READ, 5}, // 0x51
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x52
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x53
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x54
+    {"EOR", AM_ZPX, OP_READ, 4}, // 0x55
+    {"LSR", AM_ZPX, OP_READ | OP_WRITE, 6}, // 0x56
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x57
+    {"CLI", AM_IMP, 0, 2}, // 0x58
+    {"EOR", AM_ABSY, OP_READ, 4}, // 0x59
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x5A
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x5B
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x5C
+    {"EOR", AM_ABSX, OP_READ, 4}, // 0x5D
+    {"LSR", AM_ABSX, OP_READ | OP_WRITE, 7}, // 0x5E
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x5F
+    {"RTS", AM_IMP, OP_READ | OP_STACK(2), 6}, // 0x60
+    {"ADC", AM_INDX, OP_READ, 6}, // 0x61
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x62
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x63
+    {"???", AM_IMP, OP_ILLEGAL, 3}, // 0x64
+    {"ADC", AM_ZP, OP_READ, 3}, // 0x65
+    {"ROR", AM_ZP, OP_READ | OP_WRITE, 5}, // 0x66
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x67
+    {"PLA", AM_IMP, OP_READ | OP_STACK(1), 4}, // 0x68
+    {"ADC", AM_IMM, 0, 2}, // 0x69
+    {"ROR", AM_ACC, 0, 2}, // 0x6A
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x6B
+    {"JMP", AM_IND, OP_READ, 5}, // 0x6C
+    {"ADC", AM_ABS, OP_READ, 4}, // 0x6D
+    {"ROR", AM_ABS, OP_READ | OP_WRITE, 6}, // 0x6E
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x6F
+    {"BVS", AM_REL, 0, 2}, // 0x70
+    {"ADC", AM_INDY, OP_READ, 5}, // 0x71
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x72
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0x73
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x74
+    {"ADC", AM_ZPX, OP_READ, 4}, // 0x75
+    {"ROR", AM_ZPX, OP_READ | OP_WRITE, 6}, // 0x76
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x77
+    {"SEI", AM_IMP, 0, 2}, // 0x78
+    {"ADC", AM_ABSY, OP_READ, 4}, // 0x79
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x7A
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x7B
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x7C
+    {"ADC", AM_ABSX, OP_READ, 4}, // 0x7D
+    {"ROR", AM_ABSX, OP_READ | OP_WRITE, 7}, // 0x7E
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0x7F
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x80
+    {"STA", AM_INDX, OP_WRITE, 6}, // 0x81
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x82
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x83
+    {"STY", AM_ZP, OP_WRITE, 3}, // 0x84
+    {"STA", AM_ZP, OP_WRITE, 3}, // 0x85
+    {"STX", AM_ZP, OP_WRITE, 3}, // 0x86
+    {"???", AM_IMP, OP_ILLEGAL, 3}, // 0x87
+    {"DEY", AM_IMP, 0, 2}, // 0x88
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x89
+    {"TXA", AM_IMP, 0, 2}, // 0x8A
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x8B
+    {"STY", AM_ABS, OP_WRITE, 4}, // 0x8C
+    {"STA", AM_ABS, OP_WRITE, 4}, // 0x8D
+    {"STX", AM_ABS, OP_WRITE, 4}, // 0x8E
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x8F
+    {"BCC", AM_REL, 0, 2}, // 0x90
+    {"STA", AM_INDY, OP_WRITE, 6}, // 0x91
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0x92
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0x93
+    {"STY", AM_ZPX, OP_WRITE, 4}, // 0x94
+    {"STA", AM_ZPX, OP_WRITE, 4}, // 0x95
+    {"STX", AM_ZPY, OP_WRITE, 4}, // 0x96
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0x97
+    {"TYA", AM_IMP, 0, 2}, // 0x98
+    {"STA", AM_ABSY, OP_WRITE, 5}, // 0x99
+    {"TXS", AM_IMP, 0, 2}, // 0x9A
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x9B
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x9C
+    {"STA", AM_ABSX, OP_WRITE, 5}, // 0x9D
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x9E
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0x9F
+    {"LDY", AM_IMM, 0, 2}, // 0xA0
+    {"LDA", AM_INDX, OP_READ, 6}, // 0xA1
+    {"LDX", AM_IMM, 0, 2}, // 0xA2
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0xA3
+    {"LDY", AM_ZP, OP_READ, 3}, // 0xA4
+    {"LDA", AM_ZP, OP_READ, 3}, // 0xA5
+    {"LDX", AM_ZP, OP_READ, 3}, // 0xA6
+    {"???", AM_IMP, OP_ILLEGAL, 3}, // 0xA7
+    {"TAY", AM_IMP, 0, 2}, // 0xA8
+    {"LDA", AM_IMM, 0, 2}, // 0xA9
+    {"TAX", AM_IMP, 0, 2}, // 0xAA
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xAB
+    {"LDY", AM_ABS, OP_READ, 4}, // 0xAC
+    {"LDA", AM_ABS, OP_READ, 4}, // 0xAD
+    {"LDX", AM_ABS, OP_READ, 4}, // 0xAE
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xAF
+    {"BCS", AM_REL, 0, 2}, // 0xB0
+    {"LDA", AM_INDY, OP_READ, 5}, // 0xB1
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xB2
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0xB3
+    {"LDY", AM_ZPX, OP_READ, 4}, // 0xB4
+    {"LDA", AM_ZPX, OP_READ, 4}, // 0xB5
+    {"LDX", AM_ZPY, OP_READ, 4}, // 0xB6
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xB7
+    {"CLV", AM_IMP, 0, 2}, // 0xB8
+    {"LDA", AM_ABSY, OP_READ, 4}, // 0xB9
+    {"TSX", AM_IMP, 0, 2}, // 0xBA
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xBB
+    {"LDY", AM_ABSX, OP_READ, 4}, // 0xBC
+    {"LDA", AM_ABSX, OP_READ, 4}, // 0xBD
+    {"LDX", AM_ABSY, OP_READ, 4}, // 0xBE
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xBF
+    {"CPY", AM_IMM, 0, 2}, // 0xC0
+    {"CMP", AM_INDX, OP_READ, 6}, // 0xC1
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xC2
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0xC3
+    {"CPY", AM_ZP, OP_READ, 3}, // 0xC4
+    {"CMP", AM_ZP, OP_READ, 3}, // 0xC5
+    {"DEC", AM_ZP, OP_READ | OP_WRITE, 5}, // 0xC6
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0xC7
+    {"INY", AM_IMP, 0, 2}, // 0xC8
+    {"CMP", AM_IMM, 0, 2}, // 0xC9
+    {"DEX", AM_IMP, 0, 2}, // 0xCA
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xCB
+    {"CPY", AM_ABS, OP_READ, 4}, // 0xCC
+    {"CMP", AM_ABS, OP_READ, 4}, // 0xCD
+    {"DEC", AM_ABS, OP_READ | OP_WRITE, 6}, // 0xCE
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0xCF
+    {"BNE", AM_REL, 0, 2}, // 0xD0
+    {"CMP", AM_INDY, OP_READ, 5}, // 0xD1
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xD2
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0xD3
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xD4
+    {"CMP", AM_ZPX, OP_READ, 4}, // 0xD5
+    {"DEC", AM_ZPX, OP_READ | OP_WRITE, 6}, // 0xD6
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0xD7
+    {"CLD", AM_IMP, 0, 2}, // 0xD8
+    {"CMP", AM_ABSY, OP_READ, 4}, // 0xD9
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xDA
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0xDB
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xDC
+    {"CMP", AM_ABSX, OP_READ, 4}, // 0xDD
+    {"DEC", AM_ABSX, OP_READ | OP_WRITE, 7}, // 0xDE
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0xDF
+    {"CPX", AM_IMM, 0, 2}, // 0xE0
+    {"SBC", AM_INDX, OP_READ, 6}, // 0xE1
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xE2
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0xE3
+    {"CPX", AM_ZP, OP_READ, 3}, // 0xE4
+    {"SBC", AM_ZP, OP_READ, 3}, // 0xE5
+    {"INC", AM_ZP, OP_READ | OP_WRITE, 5}, // 0xE6
+    {"???", AM_IMP, OP_ILLEGAL, 5}, // 0xE7
+    {"INX", AM_IMP, 0, 2}, // 0xE8
+    {"SBC", AM_IMM, 0, 2}, // 0xE9
+    {"NOP", AM_IMP, 0, 2}, // 0xEA
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xEB
+    {"CPX", AM_ABS, OP_READ, 4}, // 0xEC
+    {"SBC", AM_ABS, OP_READ, 4}, // 0xED
+    {"INC", AM_ABS, OP_READ | OP_WRITE, 6}, // 0xEE
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0xEF
+    {"BEQ", AM_REL, 0, 2}, // 0xF0
+    {"SBC", AM_INDY, OP_READ, 5}, // 0xF1
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xF2
+    {"???", AM_IMP, OP_ILLEGAL, 8}, // 0xF3
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xF4
+    {"SBC", AM_ZPX, OP_READ, 4}, // 0xF5
+    {"INC", AM_ZPX, OP_READ | OP_WRITE, 6}, // 0xF6
+    {"???", AM_IMP, OP_ILLEGAL, 6}, // 0xF7
+    {"SED", AM_IMP, 0, 2}, // 0xF8
+    {"SBC", AM_ABSY, OP_READ, 4}, // 0xF9
+    {"???", AM_IMP, OP_ILLEGAL, 2}, // 0xFA
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0xFB
+    {"???", AM_IMP, OP_ILLEGAL, 4}, // 0xFC
+    {"SBC", AM_ABSX, OP_READ, 4}, // 0xFD
+    {"INC", AM_ABSX, OP_READ | OP_WRITE, 7}, // 0xFE
+    {"???", AM_IMP, OP_ILLEGAL, 7}, // 0xFF
+};
+
+const uint8_t ADDR_MODE_LEN[AM_COUNT] = {
+    1, // AM_IMP
+    1, // AM_ACC
+    2, // AM_IMM
+    2, // AM_ZP
+    2, // AM_ZPX
+    2, // AM_ZPY
+    3, // AM_ABS
+    3, // AM_ABSX
+    3, // AM_ABSY
+    3, // AM_IND
+    2, // AM_INDX
+    2, // AM_INDY
+    2, // AM_REL
+};
+
+bool op_access(const cpu_6502 *cpu, word ip, op_access_t *acc)
+{
+    const opcode_info_t *op = &OPCODE_INFO[cpu->mem[ip]];
+    if (!(op->access & (OP_READ | OP_WRITE)))
+        return false;
+    acc->access = op->access;
+    acc->len = 1;
+    if (OP_STACK_LEN(op->access))
+    {
+        // pushes write below SP, pulls read above it
+        acc->len = OP_STACK_LEN(op->access);
+        if (op->access & OP_WRITE)
+            acc->addr = 0x100 + (byte)(cpu->sp - acc->len + 1);
+        else
+            acc->addr = 0x100 + (byte)(cpu->sp + 1);
+        return true;
+    }
+    byte lo = cpu->mem[(word)(ip + 1)];
+    word abs = lo | ((word)cpu->mem[(word)(ip + 2)] << 8);
+    switch (op->mode)
+    {
+    case AM_ZP:
+        acc->addr = lo;
+        break;
+    case AM_ZPX:
+        acc->addr = (byte)(lo + cpu->x);
+        break;
+    case AM_ZPY:
+        acc->addr = (byte)(lo + cpu->y);
+        break;
+    case AM_ABS:
+        acc->addr = abs;
+        break;
+    case AM_ABSX:
+        acc->addr = abs + cpu->x;
+        break;
+    case AM_ABSY:
+        acc->addr = abs + cpu->y;
+        break;
+    case AM_IND: // JMP (abs) reads the target from abs, abs + 1
+        acc->addr = abs;
+        acc->len = 2;
+        break;
+    case AM_INDX:
+    {
+        byte zp = lo + cpu->x;
+        acc->addr = cpu->mem[zp] | ((word)cpu->mem[(byte)(zp + 1)] << 8);
+        break;
+    }
+    case AM_INDY:
+        acc->addr = (cpu->mem[lo] | ((word)cpu->mem[(byte)(lo + 1)] << 8)) + cpu->y;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Address operand as text, its label if there is one.
+static const char *op_addr(char *buf, size_t sz, word addr, bool zp, op_label_t label)
+{
+    const char *name = label != NULL ? label(addr) : NULL;
+    if (name != NULL)
+        return name;
+    snprintf(buf, sz, zp ? "$%02X" : "$%04X", addr);
+    return buf;
+}
+
+unsigned op_format(const byte *mem, word ip, char *buf, size_t sz, op_label_t label)
+{
+    const opcode_info_t *op = &OPCODE_INFO[mem[ip]];
+    byte lo = mem[(word)(ip + 1)];
+    word abs = lo | ((word)mem[(word)(ip + 2)] << 8);
+    char tmp[8];
+    switch (op->mode)
+    {
+    case AM_ACC:
+        snprintf(buf, sz, "%s A", op->name);
+        break;
+    case AM_IMM:
+        snprintf(buf, sz, "%s #$%02X", op->name, lo);
+        break;
+    case AM_ZP:
+        snprintf(buf, sz, "%s %s", op->name, op_addr(tmp, sizeof(tmp), lo, true, label));
+        break;
+    case AM_ZPX:
+        snprintf(buf, sz, "%s %s,X", op->name, op_addr(tmp, sizeof(tmp), lo, true, label));
+        break;
+    case AM_ZPY:
+        snprintf(buf, sz, "%s %s,Y", op->name, op_addr(tmp, sizeof(tmp), lo, true, label));
+        break;
+    case AM_ABS:
+        snprintf(buf, sz, "%s %s", op->name, op_addr(tmp, sizeof(tmp), abs, false, label));
+        break;
+    case AM_ABSX:
+        snprintf(buf, sz, "%s %s,X", op->name, op_addr(tmp, sizeof(tmp), abs, false, label));
+        break;
+    case AM_ABSY:
+        snprintf(buf, sz, "%s %s,Y", op->name, op_addr(tmp, sizeof(tmp), abs, false, label));
+        break;
+    case AM_IND:
+        snprintf(buf, sz, "%s (%s)", op->name, op_addr(tmp, sizeof(tmp), abs, false, label));
+        break;
+    case AM_INDX:
+        snprintf(buf, sz, "%s (%s,X)", op->name, op_addr(tmp, sizeof(tmp), lo, true, label));
+        break;
+    case AM_INDY:
+        snprintf(buf, sz, "%s (%s),Y", op->name, op_addr(tmp, sizeof(tmp), lo, true, label));
+        break;
+    case AM_REL:
+        snprintf(buf, sz, "%s %s", op->name, op_addr(tmp, sizeof(tmp), ip + 2 + (int8_t)lo, false, label));
+        break;
+    default:
+        snprintf(buf, sz, "%s", op->name);
+        break;
+    }
+    return ADDR_MODE_LEN[op->mode];
+}
@@ -0,0 +1,85 @@
+// 6502 opcode table and operand decoding, shared by the debugger features.
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+    AM_IMP,  // implied
+    AM_ACC,  // accumulator
+    AM_IMM,  // #imm
+    AM_ZP,   // zp
+    AM_ZPX,  // zp,X
+    AM_ZPY,  // zp,Y
+    AM_ABS,  // abs
+    AM_ABSX, // abs,X
+    AM_ABSY, // abs,Y
+    AM_IND,  // (abs)
+    AM_INDX, // (zp,X)
+    AM_INDY, // (zp),Y
+    AM_REL,  // relative branch
+    AM_COUNT
+} addr_mode_t;
+
+#define OP_READ 0x1            // reads its memory operand
+#define OP_WRITE 0x2           // writes its memory operand
+#define OP_ILLEGAL 0x4         // undocumented opcode
+#define OP_STACK(n) ((n) << 4) // pushes or pulls n bytes
+
+#define OP_STACK_LEN(access) (((access) >> 4) & 0x3)
+
+#define OPC_JSR 0x20 // opcodes the debugger steps over and out of
+#define OPC_RTS 0x60
+
+typedef struct
+{
+    char name[4];   // mnemonic
+    uint8_t mode;   // addr_mode_t
+    uint8_t access; // OP_* flags
+    uint8_t cycles; // base cycle count
+} opcode_info_t;
+
+extern const opcode_info_t OPCODE_INFO[256];
+extern const uint8_t ADDR_MODE_LEN[AM_COUNT]; // instruction length in bytes
+
+typedef struct
+{
+    word addr;      // first byte accessed
+    uint8_t len;    // number of bytes accessed
+    uint8_t access; // OP_* flags
+} op_access_t;
+
+// Address of byte k of the access, stack accesses wrap within page 1.
+static inline word op_access_addr(const op_access_t *acc, unsigned k)
+{
+    word addr = acc->addr + k;
+    return OP_STACK_LEN(acc->access) ? (word)(0x100 | (addr & 0xff)) : addr;
+}
+
+// Bytes of the access up to where a stack access wraps back to 0x100, all of
+// them if it does not.
+static inline unsigned op_access_head(const op_access_t *acc)
+{
+    unsigned room = 0x100 - (acc->addr & 0xff);
+    return OP_STACK_LEN(acc->access) && acc->len > room ? room : acc->len;
+}
+
+// Data memory accessed by the instruction at ip, evaluated with the current
+// registers, i.e. before the instruction has executed past its opcode fetch.
+// Pushes and pulls can wrap within page 1, see op_access_addr(). Returns false
+// if the instruction does not access data memory.
+bool op_access(const cpu_6502 *cpu, word ip, op_access_t *acc);
+
+// Name for an address, or NULL to show it in hex.
+typedef const char *(*op_label_t)(word addr);
+
+// Format the instruction at ip in mem as assembly, e.g. "LDA ($12),Y", with
+// branch targets resolved and addresses named by label if it is not NULL.
+// Returns the instruction length in bytes.
+unsigned op_format(const byte *mem, word ip, char *buf, size_t sz, op_label_t label = NULL);
+
+#endif // OPCODES_H
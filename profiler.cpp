@@ -0,0 +1,21 @@
+#include "profiler.h"
+#include <string.h>
+
+uint64_t prof_pc_count[MAX_MEM_SZ];
+uint64_t prof_pc_cycles[MAX_MEM_SZ];
+uint64_t prof_op_count[256];
+uint64_t prof_op_cycles[256];
+volatile bool prof_enabled = false;
+
+unsigned prof_last_ip = PROF_NONE;
+byte prof_last_op = 0;
+uint64_t prof_last_cycles = 0;
+
+void ProfileReset()
+{
+    memset(prof_pc_count, 0, sizeof(prof_pc_count));
+    memset(prof_pc_cycles, 0, sizeof(prof_pc_cycles));
+    memset(prof_op_count, 0, sizeof(prof_op_count));
+    memset(prof_op_cycles, 0, sizeof(prof_op_cycles));
+    ProfileBreak();
+}
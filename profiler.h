@@ -0,0 +1,49 @@
+// Execution profiler: executions and cycles per opcode and per instruction address.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include <stdint.h>
+
+#define PROF_NONE 0x10000 // no previous instruction to charge cycles to
+
+extern uint64_t prof_pc_count[MAX_MEM_SZ];  // executions per instruction address
+extern uint64_t prof_pc_cycles[MAX_MEM_SZ]; // cycles per instruction address
+extern uint64_t prof_op_count[256];         // executions per opcode
+extern uint64_t prof_op_cycles[256];        // cycles per opcode
+extern volatile bool prof_enabled;          // count while running, set with CMD_PROF_ENABLE
+
+extern unsigned prof_last_ip;     // instruction being executed, or PROF_NONE
+extern byte prof_last_op;         // its opcode
+extern uint64_t prof_last_cycles; // total_cycles at its first cycle
+
+// Count the instruction at cpu->instr_ptr, called on its first cycle after
+// cycles total cycles, and charge the cycles since the last call to the
+// previous instruction.
+static inline void ProfileRecord(const cpu_6502 *cpu, uint64_t cycles)
+{
+    word ip = cpu->instr_ptr;
+    byte op = cpu->mem[ip];
+    if (prof_last_ip != PROF_NONE && cycles > prof_last_cycles)
+    {
+        prof_pc_cycles[prof_last_ip] += cycles - prof_last_cycles;
+        prof_op_cycles[prof_last_op] += cycles - prof_last_cycles;
+    }
+    prof_pc_count[ip]++;
+    prof_op_count[op]++;
+    prof_last_ip = ip;
+    prof_last_op = op;
+    prof_last_cycles = cycles;
+}
+
+// Stop charging cycles to the last instruction, e.g. after the cycle count jumped.
+static inline void ProfileBreak()
+{
+    prof_last_ip = PROF_NONE;
+}
+
+// Zero all counters.
+void ProfileReset();
+
+#endif // PROFILER_H
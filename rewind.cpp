@@ -0,0 +1,125 @@
+#include "rewind.h"
+#include "emulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+rewind_entry_t *rewind_journal = NULL;
+uint64_t rewind_journal_pos = 0;
+uint64_t rewind_journal_msk = 0;
+
+static uint64_t journal_first = 0; // oldest entry not dropped by RewindUndo()
+
+// Oldest entry still in the journal.
+static uint64_t JournalFirst()
+{
+    uint64_t first = rewind_journal_pos > rewind_journal_msk + 1 ? rewind_journal_pos - rewind_journal_msk - 1 : 0;
+    return first > journal_first ? first : journal_first;
+}
+
+bool RewindEnable(unsigned cap_mb)
+{
+    free(rewind_journal);
+    rewind_journal = NULL;
+    RewindClear();
+    if (cap_mb == 0)
+        return true;
+    // the largest power of 2 journal that fits
+    uint64_t cap = (uint64_t)cap_mb << 20;
+    uint64_t entries = 2;
+    while (entries * 2 * sizeof(rewind_entry_t) <= cap)
+        entries *= 2;
+    rewind_journal = (rewind_entry_t *)malloc(entries * sizeof(rewind_entry_t));
+    if (rewind_journal == NULL)
+    {
+        perror("RewindEnable: malloc: ");
+        return false;
+    }
+    rewind_journal_msk = entries - 1;
+    return true;
+}
+
+void RewindClear()
+{
+    rewind_journal_pos = 0;
+    journal_first = 0;
+}
+
+void RewindPoke(const cpu_6502 *cpu, uint64_t cycles, word addr, unsigned len)
+{
+    for (unsigned done = 0; done < len; done += REWIND_ACC_MAX)
+    {
+        rewind_entry_t *ent = &rewind_journal[rewind_journal_pos++ & rewind_journal_msk];
+        ent->stamp = (cycles << REWIND_JOURNAL_SHIFT) | cpu->instr_ptr;
+        ent->poke = true;
+        ent->acc.addr = (word)(addr + done);
+        ent->acc.len = len - done < REWIND_ACC_MAX ? len - done : REWIND_ACC_MAX;
+        ent->acc.access = OP_WRITE;
+        for (unsigned k = 0; k < ent->acc.len; k++)
+            ent->old[k] = cpu->mem[op_access_addr(&ent->acc, k)];
+    }
+}
+
+uint64_t RewindOldest()
+{
+    if (rewind_journal == NULL)
+        return UINT64_MAX;
+    for (uint64_t pos = JournalFirst(); pos < rewind_journal_pos; pos++)
+    {
+        const rewind_entry_t *ent = &rewind_journal[pos & rewind_journal_msk];
+        if (!ent->poke)
+            return REWIND_CYCLES(ent);
+    }
+    return UINT64_MAX;
+}
+
+bool RewindFind(uint64_t before, bool brk, uint64_t *cycles, word *ip)
+{
+    if (rewind_journal == NULL)
+        return false;
+    uint64_t first = JournalFirst();
+    for (uint64_t pos = rewind_journal_pos; pos > first; pos--)
+    {
+        const rewind_entry_t *ent = &rewind_journal[(pos - 1) & rewind_journal_msk];
+        if (ent->poke || REWIND_CYCLES(ent) >= before || (brk && !bp_test(REWIND_IP(ent))))
+            continue;
+        *cycles = REWIND_CYCLES(ent);
+        *ip = REWIND_IP(ent);
+        return true;
+    }
+    return false;
+}
+
+bool RewindUndo(cpu_6502 *cpu, uint64_t cycles)
+{
+    if (rewind_journal == NULL)
+        return false;
+    uint64_t first = JournalFirst();
+    uint64_t pos = rewind_journal_pos;
+    for (; pos > first; pos--)
+    {
+        const rewind_entry_t *ent = &rewind_journal[(pos - 1) & rewind_journal_msk];
+        if (!ent->poke && REWIND_CYCLES(ent) == cycles)
+            break;
+    }
+    if (pos == first)
+        return false;
+    // newest first, each entry puts back the bytes as they were before it
+    uint64_t target = pos - 1;
+    for (pos = rewind_journal_pos; pos - 1 > target; pos--)
+    {
+        const rewind_entry_t *ent = &rewind_journal[(pos - 1) & rewind_journal_msk];
+        for (unsigned k = 0; k < ent->acc.len; k++)
+            cpu->mem[op_access_addr(&ent->acc, k)] = ent->old[k];
+    }
+    // then the target as it was on its first cycle, device reads filled in
+    const rewind_entry_t *ent = &rewind_journal[target & rewind_journal_msk];
+    for (unsigned k = 0; k < ent->acc.len; k++)
+        cpu->mem[op_access_addr(&ent->acc, k)] = ent->now[k];
+    size_t mem_off = offsetof(cpu_6502, mem);
+    memcpy(cpu, ent->regs, mem_off);
+    memcpy((byte *)cpu + mem_off + MAX_MEM_SZ, ent->regs + mem_off, REWIND_REGS_SZ - mem_off);
+    journal_first = first;
+    rewind_journal_pos = target + 1;
+    return true;
+}
@@ -0,0 +1,85 @@
+// Rewind history: a ring journal with one entry per executed instruction,
+// holding the registers at its first cycle and the bytes of its data access as
+// they were before. Any journaled boundary is restored by walking back from
+// the current state, putting back the old bytes of every instruction since,
+// newest first. Nothing is replayed, so the bytes a device filled in for a
+// read come back like any other; the devices keep their own state. Memory
+// written by the debugger is journaled the same way.
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define REWIND_CAP_MB_DEFAULT 64 // default memory cap of the history
+#define REWIND_JOURNAL_SHIFT 16  // entries hold cycles << 16 | instr_ptr
+#define REWIND_ACC_MAX 3         // most bytes an instruction accesses
+#define REWIND_REGS_SZ (sizeof(cpu_6502) - MAX_MEM_SZ) // cpu_6502 without mem
+
+typedef struct
+{
+    uint64_t stamp;              // total_cycles at its first cycle << REWIND_JOURNAL_SHIFT | instr_ptr
+    op_access_t acc;             // bytes in old and now, len 0 if none
+    bool poke;                   // memory written by the debugger, not an instruction
+    byte old[REWIND_ACC_MAX];    // the bytes before the instruction or the debugger changed them
+    byte now[REWIND_ACC_MAX];    // the bytes at its first cycle, device reads filled in
+    byte regs[REWIND_REGS_SZ];   // cpu_6502 around mem at its first cycle
+} rewind_entry_t;
+
+extern rewind_entry_t *rewind_journal; // ring of instructions, NULL when disabled
+extern uint64_t rewind_journal_pos;    // entries written since the history was cleared
+extern uint64_t rewind_journal_msk;    // ring size - 1
+
+#define REWIND_CYCLES(ent) ((ent)->stamp >> REWIND_JOURNAL_SHIFT)
+#define REWIND_IP(ent) ((word)((ent)->stamp & 0xffff))
+
+// Allocate a history of at most cap_mb MiB, or free it if cap_mb is 0.
+bool RewindEnable(unsigned cap_mb);
+// Drop all history.
+void RewindClear();
+
+// Called on the first cycle of an instruction before the bus fills in device
+// reads: note the bytes of acc, NULL if it accesses no data, as they are.
+static inline void RewindBegin(const cpu_6502 *cpu, const op_access_t *acc)
+{
+    rewind_entry_t *ent = &rewind_journal[rewind_journal_pos & rewind_journal_msk];
+    ent->poke = false;
+    ent->acc.len = 0;
+    if (acc == NULL)
+        return;
+    ent->acc = *acc;
+    for (unsigned k = 0; k < acc->len; k++)
+        ent->old[k] = cpu->mem[op_access_addr(acc, k)];
+}
+
+// Journal the instruction boundary the CPU is at after cycles total cycles,
+// once RewindBegin() noted its bytes and the bus has filled them in.
+static inline void RewindRecord(const cpu_6502 *cpu, uint64_t cycles)
+{
+    rewind_entry_t *ent = &rewind_journal[rewind_journal_pos++ & rewind_journal_msk];
+    ent->stamp = (cycles << REWIND_JOURNAL_SHIFT) | cpu->instr_ptr;
+    for (unsigned k = 0; k < ent->acc.len; k++)
+        ent->now[k] = cpu->mem[op_access_addr(&ent->acc, k)];
+    size_t mem_off = offsetof(cpu_6502, mem);
+    memcpy(ent->regs, cpu, mem_off);
+    memcpy(ent->regs + mem_off, (const byte *)cpu + mem_off + MAX_MEM_SZ, REWIND_REGS_SZ - mem_off);
+}
+
+// Journal the len bytes from addr before the debugger writes them, after
+// cycles total cycles.
+void RewindPoke(const cpu_6502 *cpu, uint64_t cycles, word addr, unsigned len);
+
+// Latest journaled boundary before cycles that can still be restored, at an
+// enabled break point if brk is set. Returns false if there is none.
+bool RewindFind(uint64_t before, bool brk, uint64_t *cycles, word *ip);
+// Put cpu back to the boundary journaled at cycles and drop the history after
+// it. Returns false, changing nothing, if the journal does not hold it.
+bool RewindUndo(cpu_6502 *cpu, uint64_t cycles);
+// Oldest boundary that can be restored, or UINT64_MAX if there is none.
+uint64_t RewindOldest();
+
+#endif // REWIND_H
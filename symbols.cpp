@@ -0,0 +1,257 @@
+#include "symbols.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define SYM_LINE_SZ 1024 // longest line read from a symbol file
+
+typedef struct
+{
+    word addr;
+    uint32_t name; // offset of the name in the name pool
+} sym_t;
+
+unsigned sym_count = 0;
+unsigned sym_gen = 0;
+
+static sym_t *syms = NULL;       // sorted by address, then by order added
+static uint32_t *by_name = NULL; // indices into syms, sorted by name
+static unsigned sym_max = 0;     // room in syms and by_name
+static char *pool = NULL;        // names, NUL terminated
+static size_t pool_sz = 0, pool_max = 0;
+static bool sorted = true;       // syms and by_name are sorted
+
+bool SymbolAdd(const char *name, size_t len, word addr)
+{
+    if (sym_count == sym_max)
+    {
+        unsigned max = sym_max ? sym_max * 2 : 1024;
+        sym_t *s = (sym_t *)realloc(syms, max * sizeof(sym_t));
+        if (s == NULL)
+            return false;
+        syms = s;
+        uint32_t *n = (uint32_t *)realloc(by_name, max * sizeof(uint32_t));
+        if (n == NULL)
+            return false;
+        by_name = n;
+        sym_max = max;
+    }
+    if (pool_sz + len + 1 > pool_max)
+    {
+        size_t max = pool_max ? pool_max * 2 : 16384;
+        while (max < pool_sz + len + 1)
+            max *= 2;
+        char *p = (char *)realloc(pool, max);
+        if (p == NULL)
+            return false;
+        pool = p;
+        pool_max = max;
+    }
+    memcpy(pool + pool_sz, name, len);
+    pool[pool_sz + len] = '\0';
+    syms[sym_count].addr = addr;
+    syms[sym_count].name = pool_sz;
+    pool_sz += len + 1;
+    sym_count++;
+    sym_gen++;
+    sorted = false;
+    return true;
+}
+
+void SymbolsClear()
+{
+    sym_count = 0;
+    pool_sz = 0;
+    sorted = true;
+    sym_gen++;
+}
+
+static int SymbolCompareAddr(const void *a, const void *b)
+{
+    const sym_t *sa = (const sym_t *)a, *sb = (const sym_t *)b;
+    if (sa->addr != sb->addr)
+        return sa->addr < sb->addr ? -1 : 1;
+    // names are added in order, keep the first one added first
+    return sa->name < sb->name ? -1 : (sa->name > sb->name ? 1 : 0);
+}
+
+static int SymbolCompareName(const void *a, const void *b)
+{
+    return strcmp(pool + syms[*(const uint32_t *)a].name, pool + syms[*(const uint32_t *)b].name);
+}
+
+static void SymbolsSort()
+{
+    if (sorted)
+        return;
+    qsort(syms, sym_count, sizeof(sym_t), SymbolCompareAddr);
+    for (unsigned i = 0; i < sym_count; i++)
+        by_name[i] = i;
+    qsort(by_name, sym_count, sizeof(uint32_t), SymbolCompareName);
+    sorted = true;
+}
+
+// First symbol at or above addr.
+static unsigned SymbolLowerBound(word addr)
+{
+    unsigned lo = 0, hi = sym_count;
+    while (lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+        if (syms[mid].addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+const char *SymbolAt(word addr)
+{
+    SymbolsSort();
+    unsigned i = SymbolLowerBound(addr);
+    return i < sym_count && syms[i].addr == addr ? pool + syms[i].name : NULL;
+}
+
+const char *SymbolNear(word addr, unsigned max, unsigned *offset)
+{
+    SymbolsSort();
+    unsigned i = SymbolLowerBound(addr);
+    if (i < sym_count && syms[i].addr == addr)
+    {
+        *offset = 0;
+        return pool + syms[i].name;
+    }
+    if (i == 0 || (unsigned)(addr - syms[i - 1].addr) > max)
+        return NULL;
+    // first of the symbols at that address
+    word below = syms[i - 1].addr;
+    i = SymbolLowerBound(below);
+    *offset = addr - below;
+    return pool + syms[i].name;
+}
+
+bool SymbolFind(const char *name, word *addr)
+{
+    SymbolsSort();
+    unsigned lo = 0, hi = sym_count;
+    while (lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+        int cmp = strcmp(pool + syms[by_name[mid]].name, name);
+        if (cmp == 0)
+        {
+            *addr = syms[by_name[mid]].addr;
+            return true;
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+static inline bool SymbolIdentChar(int c)
+{
+    return isalnum(c) || c == '_' || c == '.' || c == '@';
+}
+
+// ld65 debug file: sym	id=0,name="start",addrsize=absolute,...,val=0x8000,...
+static bool SymbolParseDbg(const char *line)
+{
+    const char *name = strstr(line, "name=\"");
+    const char *val = strstr(line, ",val=");
+    if (name == NULL || val == NULL)
+        return false; // imports have no value
+    name += 6;
+    const char *end = strchr(name, '"');
+    if (end == NULL)
+        return false;
+    char *vend;
+    unsigned long addr = strtoul(val + 5, &vend, 0);
+    if (vend == val + 5 || addr >= MAX_MEM_SZ)
+        return false;
+    return SymbolAdd(name, end - name, addr);
+}
+
+// VICE label file: al C:8000 .start
+static bool SymbolParseVice(const char *line)
+{
+    const char *p = line + 2;
+    while (isspace((byte)*p))
+        p++;
+    if (p[0] == 'C' && p[1] == ':')
+        p += 2;
+    char *end;
+    unsigned long addr = strtoul(p, &end, 16);
+    if (end == p || addr >= MAX_MEM_SZ)
+        return false;
+    p = end;
+    while (isspace((byte)*p))
+        p++;
+    if (*p == '.')
+        p++;
+    size_t len = 0;
+    while (SymbolIdentChar((byte)p[len]))
+        len++;
+    return len > 0 && SymbolAdd(p, len, addr);
+}
+
+// name = $8000, also name equ $8000, with $hex, 0xhex or decimal values
+static bool SymbolParseAssign(const char *line)
+{
+    const char *p = line;
+    size_t len = 0;
+    while (SymbolIdentChar((byte)p[len]))
+        len++;
+    if (len == 0)
+        return false;
+    const char *q = p + len;
+    while (isspace((byte)*q))
+        q++;
+    if (*q == '=')
+        q++;
+    else if (strncasecmp(q, "equ", 3) == 0 && isspace((byte)q[3]))
+        q += 3;
+    else
+        return false;
+    while (isspace((byte)*q))
+        q++;
+    const char *num = *q == '$' ? q + 1 : q;
+    char *end;
+    unsigned long addr = strtoul(num, &end, *q == '$' ? 16 : 0);
+    if (end == num || addr >= MAX_MEM_SZ)
+        return false;
+    return SymbolAdd(p, len, addr);
+}
+
+int SymbolsLoad(const char *fname)
+{
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL)
+    {
+        printf("Could not open symbol file %s\n", fname);
+        return -1;
+    }
+    char line[SYM_LINE_SZ];
+    unsigned count = sym_count;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        const char *p = line;
+        while (isspace((byte)*p))
+            p++;
+        // lines of other kinds are skipped, debug files hold many
+        if (strncmp(p, "sym", 3) == 0 && isspace((byte)p[3]))
+            SymbolParseDbg(p);
+        else if (strncmp(p, "al", 2) == 0 && isspace((byte)p[2]))
+            SymbolParseVice(p);
+        else
+            SymbolParseAssign(p);
+    }
+    fclose(fp);
+    printf("Loaded %u symbols from %s\n", sym_count - count, fname);
+    return sym_count - count;
+}
@@ -0,0 +1,33 @@
+// Symbol table: names for addresses, loaded from ld65 debug files (.dbg),
+// VICE label files (al C:8000 .name) or plain "name = $8000" lines. Kept as
+// one array sorted by address and one sorted by name, so that both lookups
+// are binary searches. Only used from the GUI or headless main thread.
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include <stdint.h>
+#include <stddef.h>
+
+#define SYM_NEAR_MAX 0x100 // max distance SymbolNear() looks back by default
+
+extern unsigned sym_count; // number of symbols
+extern unsigned sym_gen;   // changes whenever the symbols change
+
+// Add the symbol name[0, len) at addr. Returns false if out of memory.
+bool SymbolAdd(const char *name, size_t len, word addr);
+// Load the symbols of fname, in any of the formats above. Returns the number
+// of symbols loaded, or -1 if the file could not be read.
+int SymbolsLoad(const char *fname);
+// Drop all symbols.
+void SymbolsClear();
+// Name of a symbol at addr, or NULL.
+const char *SymbolAt(word addr);
+// Name of the closest symbol at or below addr, at most max bytes below, and
+// its distance to addr in *offset. Returns NULL if there is none.
+const char *SymbolNear(word addr, unsigned max, unsigned *offset);
+// Address of the symbol name. Returns false if there is none.
+bool SymbolFind(const char *name, word *addr);
+
+#endif // SYMBOLS_H
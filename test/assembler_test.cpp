@@ -0,0 +1,148 @@
+// Assembler output for a known program, the errors of bad lines, and random
+// edits assembled incrementally against a fresh assembly of the same source.
+
+#include "assembler.h"
+#include "test.h"
+
+static asm_t as, ref;
+
+// The assembled bytes from addr are the n bytes of want, and nothing around them.
+static bool AsmBytes(const asm_t *a, word addr, const byte *want, unsigned n)
+{
+    if (AsmUsed(a, addr - 1) || AsmUsed(a, addr + n))
+        return false;
+    for (unsigned i = 0; i < n; i++)
+        if (!AsmUsed(a, addr + i) || a->image[(word)(addr + i)] != want[i])
+            return false;
+    return true;
+}
+
+// Whether the error list has one on line.
+static bool AsmErrorOn(const asm_t *a, unsigned line)
+{
+    for (unsigned i = 0; i < a->nerrors && i < ASM_MAX_ERRORS; i++)
+        if (a->errors[i].line == line)
+            return true;
+    return false;
+}
+
+static const char *const EDITS[] = {
+    "a%d: LDA #%d", " STA $%02X", " STA $%04X,X", " BNE a%d", " JMP a%d", " LDA b%d", "b%d = $%02X",
+    " .byte %d, \"hi\"", " .word a%d, *", " .res %d, $ee", " .org $80%02X", "c%d: NOP", " LDA (b%d),Y",
+    " LDX b%d+%d", " bogus %d", "a%d: INX", " LDA zz%d", "zz%d = a%d + 1", " DEX", "; c %d",
+};
+
+static void AsmRandomLine(char *buf)
+{
+    const char *fmt = EDITS[rand() % (sizeof(EDITS) / sizeof(EDITS[0]))];
+    sprintf(buf, fmt, rand() % 8, rand() % 256);
+}
+
+int main()
+{
+    static const char prog[] =
+        "; test program\n"
+        "        .org $8000\n"
+        "start:  LDA #$00\n"
+        "loop:   NOP\n"
+        "        JMP (vector)\n"
+        "zp = $10\n"
+        "        LDA zp\n"
+        "        BNE loop\n"
+        "        JMP fwd\n"
+        "        .byte 1, \"Hi\", 'x', -1\n"
+        "        .word start\n"
+        "        .res 2, $ff\n"
+        "fwd:    RTS\n"
+        "        .org $9000\n"
+        "vector: .word loop\n";
+    static const byte code[] = {0xa9, 0x00, 0xea, 0x6c, 0x00, 0x90, 0xa5, 0x10, 0xd0, 0xf8, 0x4c, 0x16, 0x80,
+                                0x01, 0x48, 0x69, 0x78, 0xff, 0x00, 0x80, 0xff, 0xff, 0x60};
+    static const byte vector[] = {0x02, 0x80};
+    CHECK(AsmAssemble(&as, prog));
+    CHECK(as.nerrors == 0 && as.bytes == sizeof(code) + sizeof(vector) && as.start == 0x8000);
+    CHECK(AsmBytes(&as, 0x8000, code, sizeof(code)));
+    CHECK(AsmBytes(&as, 0x9000, vector, sizeof(vector)));
+    long val;
+    CHECK(AsmSymbol(&as, "fwd", &val) && val == 0x8016);
+    CHECK(AsmSymbol(&as, "zp", &val) && val == 0x10);
+    CHECK(!AsmSymbol(&as, "nothing", &val));
+
+    // the same source again reuses every line
+    CHECK(AsmAssemble(&as, prog) && as.parsed == 0 && as.emitted == 0);
+    CHECK(AsmBytes(&as, 0x8000, code, sizeof(code)));
+
+    static const char bad[] =
+        " LDA #$100\n"   // 1: immediate out of range
+        " BNE far\n"     // 2: branch out of range
+        " .org $9000\n"
+        "far: NOP\n"
+        " foo\n"         // 5: unknown mnemonic
+        " STA (1,Y)\n"   // 6: no such addressing mode
+        " LDA undef\n"   // 7: undefined symbol
+        "x: NOP\n"
+        "x: NOP\n"       // 9: duplicate label
+        " .byte \"abc\n" // 10: unterminated string
+        " JMP ($1234\n"; // 11: missing parenthesis
+    CHECK(!AsmAssemble(&as, bad));
+    CHECK(as.nerrors == 8);
+    static const unsigned bad_lines[] = {1, 2, 5, 6, 7, 9, 10, 11};
+    for (unsigned i = 0; i < sizeof(bad_lines) / sizeof(bad_lines[0]); i++)
+        CHECK(AsmErrorOn(&as, bad_lines[i]));
+    CHECK(!AsmErrorOn(&as, 3) && !AsmErrorOn(&as, 4) && !AsmErrorOn(&as, 8));
+
+    // random edits: the incremental result matches a fresh assembly, and
+    // every address that changed is marked
+    srand(1);
+    static char lines[100][64];
+    static char src[100 * 64 + 1];
+    static byte prev[MAX_MEM_SZ];
+    static uint64_t prev_used[MAX_MEM_SZ / 64];
+    unsigned n = 20;
+    for (unsigned i = 0; i < n; i++)
+        AsmRandomLine(lines[i]);
+    AsmFree(&as);
+    memset(&as, 0, sizeof(as));
+    bool same = true, marked = true;
+    for (int iter = 0; iter < 500; iter++)
+    {
+        unsigned k = rand() % n;
+        int op = rand() % 3;
+        if (op == 0)
+            AsmRandomLine(lines[k]);
+        else if (op == 1 && n < 100)
+        {
+            memmove(lines[k + 1], lines[k], (n - k) * sizeof(lines[0]));
+            AsmRandomLine(lines[k]);
+            n++;
+        }
+        else if (n > 1)
+        {
+            memmove(lines[k], lines[k + 1], (n - k - 1) * sizeof(lines[0]));
+            n--;
+        }
+        size_t pos = 0;
+        for (unsigned i = 0; i < n; i++)
+            pos += sprintf(src + pos, "%s\n", lines[i]);
+        AsmAssemble(&as, src);
+        AsmFree(&ref);
+        memset(&ref, 0, sizeof(ref));
+        AsmAssemble(&ref, src);
+        same = same && memcmp(as.image, ref.image, MAX_MEM_SZ) == 0 && memcmp(as.used, ref.used, sizeof(as.used)) == 0 &&
+               as.nerrors == ref.nerrors && as.bytes == ref.bytes && as.start == ref.start;
+        for (unsigned a = 0; a < MAX_MEM_SZ; a++)
+        {
+            bool used = AsmUsed(&as, a), was = (prev_used[a >> 6] >> (a & 63)) & 1;
+            if ((used != was || (used && as.image[a] != prev[a])) && !((as.changed[a >> 6] >> (a & 63)) & 1))
+                marked = false;
+        }
+        memcpy(prev, as.image, MAX_MEM_SZ);
+        memcpy(prev_used, as.used, sizeof(prev_used));
+        memset(as.changed, 0, sizeof(as.changed));
+    }
+    CHECK(same);
+    CHECK(marked);
+    AsmFree(&as);
+    AsmFree(&ref);
+    return TestDone("assembler");
+}
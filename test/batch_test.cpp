@@ -0,0 +1,90 @@
+// Batched execution: the cycles run follow the wall clock at the set
+// frequency, a late tick catches up on at most CPU_BATCH_MAX_TICKS ticks,
+// a run in batches ends in the same state as one cycle at a time, and the
+// published memory follows the CPU.
+
+#include "emulator.h"
+#include "test.h"
+
+#define FREQ 1000000 // 1 MHz
+
+// Counting loop at 0x0400, with the reset vector pointing there.
+static void Load()
+{
+    static const byte loop[] = {
+        0xe8,             // INX
+        0xd0, 0xfd,       // BNE $0400
+        0xc8,             // INY
+        0x4c, 0x00, 0x04, // JMP $0400
+    };
+    memset(cpu->mem, 0, MAX_MEM_SZ);
+    memcpy(&cpu->mem[0x400], loop, sizeof(loop));
+    cpu->mem[V_RESET] = 0x00, cpu->mem[V_RESET + 1] = 0x04;
+    CPUReset();
+    CPUStart();
+}
+
+int main()
+{
+    cpu = (cpu_6502 *)calloc(1, sizeof(cpu_6502));
+    cpufreq = FREQ;
+    trap_detect = false;
+    Load();
+
+    // one tick per CPU_BATCH_TICK_NS: never ahead of the clock, and not far
+    // behind it on an idle machine
+    CPUBatch();
+    uint64_t start = get_monotonic_ns(), start_cycles = total_cycles;
+    unsigned ticks = 0;
+    while (get_monotonic_ns() - start < 100000000ULL) // 100 ms
+    {
+        usleep(CPU_BATCH_TICK_NS / 1000);
+        CPUBatch();
+        ticks++;
+    }
+    double due = (get_monotonic_ns() - start) * 1e-9 * FREQ;
+    uint64_t ran = total_cycles - start_cycles;
+    CHECK(ran <= due + 1);
+    CHECK(ran >= due / 2);
+    CHECK(ticks < ran / 100); // many cycles per wakeup
+
+    // a tick after a long stall runs no more than the catch-up limit
+    uint64_t max_cycles = FREQ * CPU_BATCH_TICK_NS * CPU_BATCH_MAX_TICKS / NSEC_PER_SEC + 1;
+    usleep(20000);
+    uint64_t before = total_cycles;
+    CPUBatch();
+    CHECK(total_cycles - before <= max_cycles);
+    CHECK(total_cycles - before >= max_cycles / 2);
+
+    // paused, nothing runs
+    CPUCommand(CMD_PAUSE);
+    CPUDrain();
+    before = total_cycles;
+    usleep(2000);
+    CPUBatch();
+    CHECK(total_cycles == before);
+
+    // the same number of cycles one at a time ends in the same state
+    static cpu_6502 batched;
+    memcpy(&batched, cpu, sizeof(batched));
+    uint64_t cycles = total_cycles;
+    Load();
+    for (uint64_t c = 0; c < cycles; c++)
+        CPUCycle();
+    CHECK(total_cycles == cycles);
+    CHECK(cpu->pc == batched.pc && cpu->x == batched.x && cpu->y == batched.y && cpu->n == batched.n && cpu->z == batched.z);
+    CHECK(memcmp(batched.mem, cpu->mem, MAX_MEM_SZ) == 0);
+
+    // memory is published with the registers, a write only moves its page
+    CPUPublish(true);
+    static cpu_mem_view_t view;
+    cpu_snapshot_t regs;
+    CPUSnapshot(&regs, &view);
+    CHECK(regs.total_cycles == total_cycles && memcmp(view.mem, cpu->mem, MAX_MEM_SZ) == 0);
+    CPUCommand(CMD_WRITE_MEM, 0x1234, 0x5a);
+    CPUDrain();
+    CPUSnapshot(&regs, &view);
+    CHECK(view.mem[0x1234] == 0x5a && view.page[0x12] > view.page[0x11]);
+
+    return TestDone("batch");
+}
@@ -0,0 +1,134 @@
+// Writes to ROM, checked after every cycle and through rewind, and for
+// a push that wraps the stack, and device writes arriving before the next
+// instruction reads the device.
+
+#include "emulator.h"
+#include "test.h"
+
+#define ROM_ADDR 0xc000 // protected byte the program increments
+#define ROM_VAL 0x42
+#define DEV_PAGE 0xd0
+
+static unsigned dev_writes = 0;
+static byte dev_last = 0;
+
+static byte DevRead(void *, word)
+{
+    return dev_last * 2;
+}
+
+static void DevWrite(void *, word, byte val)
+{
+    dev_writes++;
+    dev_last = val;
+}
+
+static const bus_device_t dev = {"test", DevRead, DevWrite, NULL};
+
+// Load code at 0x0400 with the reset vector pointing there.
+static void Load(const byte *code, unsigned n)
+{
+    memset(cpu->mem, 0, MAX_MEM_SZ);
+    memcpy(&cpu->mem[0x400], code, n);
+    cpu->mem[V_RESET] = 0x00, cpu->mem[V_RESET + 1] = 0x04;
+    cpu->mem[ROM_ADDR] = ROM_VAL;
+}
+
+int main()
+{
+    cpu = (cpu_6502 *)calloc(1, sizeof(cpu_6502));
+    // INC on ROM, then read it back and count the loops in RAM
+    static const byte rmw[] = {
+        0xee, 0x00, 0xc0, // INC $C000
+        0xfe, 0xff, 0xbf, // INC $BFFF,X
+        0xad, 0x00, 0xc0, // LDA $C000
+        0x85, 0x10,       // STA $10
+        0xe6, 0x11,       // INC $11
+        0x4c, 0x00, 0x04, // JMP $0400
+    };
+    Load(rmw, sizeof(rmw));
+    CHECK(BusProtect(cpu, ROM_ADDR, ROM_ADDR, true));
+    CPUReset();
+    cpu->x = 1;
+    CHECK(CPURewindEnable(8));
+    CPUStart();
+
+    // no cycle sees the incremented byte
+    static cpu_6502 states[256];
+    static uint64_t state_cycles[256];
+    unsigned nstates = 0;
+    bool kept = true;
+    word ip = cpu->instr_ptr;
+    for (int c = 0; c < 2000 && cpu_running; c++)
+    {
+        CPURunBlock(1, NULL);
+        kept = kept && cpu->mem[ROM_ADDR] == ROM_VAL;
+        if (cpu->instr_ptr != ip && nstates < 256)
+        {
+            ip = cpu->instr_ptr;
+            memcpy(&states[nstates], cpu, sizeof(cpu_6502));
+            state_cycles[nstates++] = total_cycles;
+        }
+    }
+    CHECK(kept);
+    CHECK(cpu->mem[0x10] == ROM_VAL && cpu->mem[0x11] > 10);
+
+    // stepping back replays the same states, ROM included
+    bool same = true;
+    unsigned back = 0;
+    while (CPUStepBack() && back < nstates)
+    {
+        for (unsigned i = 0; i < nstates; i++)
+        {
+            if (state_cycles[i] != total_cycles)
+                continue;
+            const cpu_6502 *s = &states[i];
+            same = same && s->a == cpu->a && s->x == cpu->x && s->pc == cpu->pc && s->instr_ptr == cpu->instr_ptr &&
+                   memcmp(s->mem, cpu->mem, MAX_MEM_SZ) == 0;
+            back++;
+        }
+    }
+    CHECK(back > 100);
+    CHECK(same);
+    CHECK(cpu->mem[ROM_ADDR] == ROM_VAL);
+
+    // every store reaches the device before the next instruction reads it,
+    // stores of the same value included
+    static const byte io[] = {
+        0xa9, 0x05,       // LDA #$05
+        0x8d, 0x00, 0xd0, // STA $D000
+        0x8d, 0x00, 0xd0, // STA $D000
+        0xae, 0x00, 0xd0, // LDX $D000
+        0x4c, 0x0b, 0x04, // JMP *
+    };
+    Load(io, sizeof(io));
+    CHECK(CPUBusMap(DEV_PAGE, 1, BUS_DEVICE, &dev));
+    CPUReset();
+    CPUStart();
+    for (int c = 0; c < 40 && cpu_running; c++)
+        CPURunBlock(1, NULL);
+    CHECK(dev_writes == 2);
+    CHECK(cpu->x == 10);
+
+    // a push that wraps within page 1 is undone on both sides of the wrap
+    static const byte wrap[] = {
+        0xa2, 0x00,       // LDX #$00
+        0x9a,             // TXS
+        0x20, 0x00, 0x05, // JSR $0500
+    };
+    Load(wrap, sizeof(wrap));
+    cpu->mem[0x500] = 0x4c, cpu->mem[0x501] = 0x00, cpu->mem[0x502] = 0x05; // JMP $0500
+    cpu->mem[0x100] = ROM_VAL;
+    CHECK(BusProtect(cpu, 0x100, 0x100, true));
+    CPUReset();
+    CPUStart();
+    kept = true;
+    for (int c = 0; c < 40 && cpu_running; c++)
+    {
+        CPURunBlock(1, NULL);
+        kept = kept && cpu->mem[0x100] == ROM_VAL;
+    }
+    CHECK(kept);
+    CHECK(cpu->pc == 0x500 && cpu->sp == 0xfe && cpu->mem[0x1ff] == 0x05);
+    return TestDone("bus");
+}
@@ -0,0 +1,88 @@
+// Round trips of the delta coding against a base and against zeros, and
+// decoding of truncated and corrupted input.
+
+#include "delta.h"
+#include "test.h"
+
+static byte src[MAX_MEM_SZ], base[MAX_MEM_SZ], dst[MAX_MEM_SZ];
+static byte enc[DELTA_BOUND(MAX_MEM_SZ)];
+
+// Encode n bytes of src against b and check that they decode back.
+static size_t RoundTrip(const byte *b, size_t n)
+{
+    size_t len = DeltaEncode(src, b, n, enc);
+    CHECK(len <= DELTA_BOUND(n));
+    memset(dst, 0x5a, n);
+    CHECK(DeltaDecode(enc, len, b, dst, n) == len);
+    CHECK(memcmp(dst, src, n) == 0);
+    return len;
+}
+
+int main()
+{
+    srand(1);
+    for (unsigned i = 0; i < MAX_MEM_SZ; i++)
+        base[i] = rand();
+
+    // equal to the base, to zeros, all one byte and all random
+    memcpy(src, base, MAX_MEM_SZ);
+    CHECK(RoundTrip(base, MAX_MEM_SZ) < 8);
+    memset(src, 0, MAX_MEM_SZ);
+    CHECK(RoundTrip(NULL, MAX_MEM_SZ) < 8);
+    memset(src, 0xea, MAX_MEM_SZ);
+    CHECK(RoundTrip(base, MAX_MEM_SZ) < 8);
+    for (unsigned i = 0; i < MAX_MEM_SZ; i++)
+        src[i] = rand();
+    RoundTrip(base, MAX_MEM_SZ);
+    RoundTrip(NULL, MAX_MEM_SZ);
+    RoundTrip(base, 1);
+
+    // the base with runs changed, around the minimum skip and fill lengths
+    for (int iter = 0; iter < 200; iter++)
+    {
+        size_t n = 1 + rand() % 4096;
+        memcpy(src, base, n);
+        for (int k = rand() % 20; k > 0; k--)
+        {
+            size_t at = rand() % n;
+            size_t len = 1 + rand() % (DELTA_MIN_FILL + 2);
+            byte val = rand();
+            bool fill = rand() & 1;
+            for (size_t j = at; j < at + len && j < n; j++)
+                src[j] = fill ? val : rand();
+        }
+        RoundTrip(iter & 1 ? base : NULL, n);
+    }
+
+    // every truncation of a valid encoding is rejected
+    size_t len = RoundTrip(base, 4096);
+    for (size_t cut = 0; cut < len; cut++)
+        CHECK(DeltaDecode(enc, cut, base, dst, 4096) == 0);
+
+    // tokens that run past the end of the buffer or have no kind
+    static const byte too_long[] = {0x80, 0x02}; // skip 64
+    CHECK(DeltaDecode(too_long, sizeof(too_long), base, dst, 63) == 0);
+    static const byte empty[] = {0 << 2 | DELTA_COPY};
+    CHECK(DeltaDecode(empty, sizeof(empty), base, dst, 1) == 0);
+    static const byte bad_kind[] = {1 << 2 | 3, 0};
+    CHECK(DeltaDecode(bad_kind, sizeof(bad_kind), base, dst, 1) == 0);
+    static const byte overlong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+    CHECK(DeltaDecode(overlong, sizeof(overlong), base, dst, 1) == 0);
+
+    // trailing bytes after the tokens are left to the caller
+    static const byte fill[] = {8 << 2 | DELTA_FILL, 0x42, 0xff};
+    CHECK(DeltaDecode(fill, sizeof(fill), NULL, dst, 8) == 2);
+    CHECK(dst[0] == 0x42 && dst[7] == 0x42);
+
+    // random corruption must not decode more than n bytes or crash
+    len = RoundTrip(base, 4096);
+    for (int iter = 0; iter < 1000; iter++)
+    {
+        static byte bad[DELTA_BOUND(4096)];
+        memcpy(bad, enc, len);
+        bad[rand() % len] ^= 1 << (rand() % 8);
+        size_t used = DeltaDecode(bad, len, base, dst, 4096);
+        CHECK(used <= len);
+    }
+    return TestDone("delta");
+}
@@ -0,0 +1,79 @@
+// Decode cache invalidation by bytes and symbols, and DisasmBack() finding
+// the instruction starts before an address in mixed length code.
+
+#include "disasm.h"
+#include "symbols.h"
+#include "test.h"
+
+static byte mem[MAX_MEM_SZ];
+
+// Whether decoding forward from start reaches addr in exactly n instructions.
+static bool DecodesInto(word start, word addr, unsigned n)
+{
+    unsigned pc = start;
+    for (unsigned i = 0; i < n && pc < addr; i++)
+        pc += DisasmLookup(mem, pc)->len;
+    return pc == addr && (n == 0 || start < addr);
+}
+
+int main()
+{
+    // cached text follows the bytes and the symbols
+    static const byte lda[] = {0xad, 0x34, 0x12};
+    memcpy(&mem[0x200], lda, sizeof(lda));
+    const disasm_entry_t *ent = DisasmLookup(mem, 0x200);
+    CHECK(ent->len == 3 && strcmp(ent->text, "LDA $1234") == 0);
+    CHECK(DisasmLookup(mem, 0x200) == ent);
+    mem[0x202] = 0x56;
+    CHECK(strcmp(DisasmLookup(mem, 0x200)->text, "LDA $5634") == 0);
+    CHECK(SymbolAdd("port", 4, 0x5634));
+    CHECK(strcmp(DisasmLookup(mem, 0x200)->text, "LDA port") == 0);
+    SymbolsClear();
+    CHECK(strcmp(DisasmLookup(mem, 0x200)->text, "LDA $5634") == 0);
+    // operands wrap around the end of memory
+    mem[0xffff] = 0x4c, mem[0x0000] = 0x00, mem[0x0001] = 0x80;
+    CHECK(strcmp(DisasmLookup(mem, 0xffff)->text, "JMP $8000") == 0);
+
+    // all three byte instructions whose operands decode as NOPs: every
+    // candidate resyncs, so the answer is exact
+    for (unsigned a = 0x1000; a < 0x2000; a += 3)
+        mem[a] = 0xad, mem[a + 1] = 0xea, mem[a + 2] = 0xea;
+    CHECK(DisasmBack(mem, 0x1300, 0) == 0x1300);
+    CHECK(DisasmBack(mem, 0x1300, 1) == 0x12fd);
+    CHECK(DisasmBack(mem, 0x1300, 10) == 0x1300 - 30);
+
+    // random code of mixed lengths: the result is a start that decodes into
+    // addr, and for most addresses it is the real instruction n back
+    srand(1);
+    static word starts[0x4000];
+    unsigned count = 0;
+    for (unsigned a = 0x4000; a < 0x8000; count++)
+    {
+        starts[count] = a;
+        byte op = rand();
+        unsigned len = ADDR_MODE_LEN[OPCODE_INFO[op].mode];
+        mem[a] = op;
+        for (unsigned i = 1; i < len; i++)
+            mem[a + i] = rand();
+        a += len;
+    }
+    unsigned tried = 0, decodes = 0, exact = 0;
+    for (unsigned k = 16; k < count - 1; k += 7)
+    {
+        for (unsigned n = 1; n <= 8; n++)
+        {
+            word back = DisasmBack(mem, starts[k], n);
+            tried++;
+            decodes += DecodesInto(back, starts[k], n);
+            exact += back == starts[k - n];
+        }
+    }
+    CHECK(decodes == tried);
+    CHECK(exact * 10 >= tried * 9);
+
+    // near address 0 there may be fewer than n instructions before addr
+    memset(mem, 0xea, 0x10);
+    CHECK(DisasmBack(mem, 0x0004, 8) == 0x0000);
+    CHECK(DisasmBack(mem, 0x0000, 8) == 0x0000);
+    return TestDone("disasm");
+}
@@ -0,0 +1,162 @@
+// Intel HEX and S-record files written from random data load back into the
+// same bytes, raw and PRG files land at their address, and malformed records
+// fail the load.
+
+#include "loader.h"
+#include "emulator.h"
+#include "test.h"
+
+static load_t ld;
+static byte data[MAX_MEM_SZ];
+static char text[1 << 20];
+
+// Append one record of the n bytes at rec as hex with its checksum, Intel HEX
+// if ihex else an S-record of type.
+static size_t Record(char *out, bool ihex, int type, const byte *rec, unsigned n)
+{
+    byte sum = 0;
+    size_t len = ihex ? sprintf(out, ":") : sprintf(out, "S%d", type);
+    for (unsigned i = 0; i < n; i++)
+    {
+        len += sprintf(out + len, "%02X", rec[i]);
+        sum += rec[i];
+    }
+    return len + sprintf(out + len, "%02X\r\n", ihex ? (byte)-sum : (byte)~sum);
+}
+
+// Write the n bytes of data from addr as records of up to 32 bytes.
+static size_t Records(char *out, bool ihex, unsigned addr, unsigned n, unsigned entry)
+{
+    size_t len = 0;
+    byte rec[40];
+    if (!ihex)
+    {
+        static const byte head[] = {5, 0, 0, 'T', 'S'};
+        len += Record(out + len, false, 0, head, sizeof(head));
+    }
+    for (unsigned pos = 0; pos < n; pos += 32)
+    {
+        unsigned cnt = n - pos < 32 ? n - pos : 32;
+        word a = addr + pos;
+        if (ihex)
+        {
+            rec[0] = cnt, rec[1] = a >> 8, rec[2] = a, rec[3] = 0x00;
+            memcpy(&rec[4], &data[a], cnt);
+            len += Record(out + len, true, 0, rec, cnt + 4);
+        }
+        else
+        {
+            rec[0] = cnt + 3, rec[1] = a >> 8, rec[2] = a;
+            memcpy(&rec[3], &data[a], cnt);
+            len += Record(out + len, false, 1, rec, cnt + 3);
+        }
+    }
+    rec[0] = ihex ? 4 : 3, rec[1] = rec[2] = 0;
+    if (ihex)
+    {
+        rec[3] = 0x05, rec[4] = rec[5] = 0, rec[6] = entry >> 8, rec[7] = entry;
+        len += Record(out + len, true, 0, rec, 8);
+        rec[0] = 0, rec[3] = 0x01;
+        len += Record(out + len, true, 0, rec, 4);
+    }
+    else
+    {
+        rec[1] = entry >> 8, rec[2] = entry;
+        len += Record(out + len, false, 9, rec, 3);
+    }
+    return len;
+}
+
+// Load the len bytes at buf as a file with extension ext.
+static bool Load(const void *buf, size_t len, const char *ext, load_format_t fmt, word base)
+{
+    char fname[64];
+    TestFile(fname, sizeof(fname), ext, buf, len);
+    bool ok = LoadFile(&ld, fname, fmt, base);
+    unlink(fname);
+    return ok;
+}
+
+// The loaded bytes are data[addr, addr + n) and nothing else is set.
+static bool Loaded(unsigned addr, unsigned n)
+{
+    if (ld.bytes != n || (n && (ld.lo != addr || ld.hi != addr + n - 1)))
+        return false;
+    for (unsigned a = 0; a < MAX_MEM_SZ; a++)
+    {
+        bool in = a >= addr && a < addr + n;
+        if (LoadUsed(&ld, a) != in || (in && ld.image[a] != data[a]))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    srand(1);
+    for (unsigned i = 0; i < MAX_MEM_SZ; i++)
+        data[i] = rand();
+
+    // round trips through both record formats, up to the end of memory
+    static const unsigned ranges[][2] = {{0x0000, 1}, {0x8000, 1000}, {0x1234, 31}, {0xffc0, 0x40}, {0x0000, MAX_MEM_SZ}};
+    for (unsigned r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+    {
+        for (int ihex = 0; ihex < 2; ihex++)
+        {
+            size_t len = Records(text, ihex, ranges[r][0], ranges[r][1], 0x8123);
+            CHECK(Load(text, len, ihex ? ".hex" : ".s19", LOAD_AUTO, 0));
+            CHECK(ld.format == (ihex ? LOAD_IHEX : LOAD_SREC));
+            CHECK(Loaded(ranges[r][0], ranges[r][1]));
+            CHECK(LoadEntry(&ld) == 0x8123);
+        }
+    }
+
+    // raw files at the base address, PRG files at their load address
+    CHECK(Load(&data[0x400], 0x100, ".bin", LOAD_AUTO, 0x400) && ld.format == LOAD_RAW && Loaded(0x400, 0x100));
+    CHECK(LoadEntry(&ld) == 0x400);
+    CHECK(!Load(&data[0x400], 0x100, ".bin", LOAD_RAW, 0xff80));
+    byte prg[0x102] = {0x01, 0x08};
+    memcpy(&prg[2], &data[0x801], 0x100);
+    CHECK(Load(prg, sizeof(prg), ".prg", LOAD_AUTO, 0) && ld.format == LOAD_PRG && Loaded(0x801, 0x100));
+    CHECK(!Load(prg, 1, ".prg", LOAD_AUTO, 0));
+    CHECK(Load(text, 0, ".bin", LOAD_AUTO, 0) && ld.bytes == 0 && LoadEntry(&ld) == ADDR_INVALID);
+    CHECK(!LoadFile(&ld, "/nonexistent/file.hex", LOAD_AUTO, 0));
+
+    // the reset vector is the entry if the file gives none
+    static const char vec[] = ":02FFFC0000C043\n:00000001FF\n";
+    CHECK(Load(vec, sizeof(vec) - 1, ".hex", LOAD_AUTO, 0) && LoadEntry(&ld) == 0xc000);
+
+    // malformed records, each must fail the load
+    static const char *const bad[] = {
+        ":0380000001020375\n",       // bad checksum
+        ":038000000102G377\n",       // bad digit
+        ":0380000001020\n",          // short record
+        ":03800000010203770\n",      // digit left over
+        ":0280000001\n",             // shorter than its header
+        ":04FFFE0001020304F5\n",     // data beyond 64 KiB
+        ":020000040001F9\n:0100000001FE\n", // data above 64 KiB after an extended address
+        ":00000007F9\n",             // unknown record type
+        ":0400000500010000F6\n",     // start address beyond 64 KiB
+        "0380000001020377\n",        // missing ':'
+        "S106800001020374\n",        // bad checksum
+        "S10680000102037\n",         // short record
+        "S406800001020373\n",        // unknown record type
+        "S1 06800001020373\n",       // space inside the record
+        "S20801000001020300F0\n",    // S2 above 64 KiB
+        "S\n",                       // no type
+    };
+    for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        bool srec = bad[i][0] == 'S';
+        bool ok = Load(bad[i], strlen(bad[i]), srec ? ".s19" : ".hex", srec ? LOAD_SREC : LOAD_IHEX, 0);
+        if (ok)
+            printf("loaded bad record %u: %s", i, bad[i]);
+        CHECK(!ok);
+    }
+    // blank lines and trailing white space are fine, text after the EOF record is ignored
+    static const char good[] = "\n  \r\n:0380000001020377  \r\n:00000001FF\ngarbage\n";
+    CHECK(Load(good, sizeof(good) - 1, ".hex", LOAD_IHEX, 0) && ld.bytes == 3 && ld.image[0x8002] == 3);
+    static const char srec[] = "S106800001020373\nS9030000FC";
+    CHECK(Load(srec, sizeof(srec) - 1, ".s19", LOAD_AUTO, 0) && ld.bytes == 3 && ld.image[0x8000] == 1);
+    return TestDone("loader");
+}
@@ -0,0 +1,163 @@
+// Rewind: stepping back restores every journaled boundary exactly, memory
+// filled in by a device and written by the debugger included, Run Back stops
+// at break points, and a full journal still goes back to its oldest entry.
+
+#include "emulator.h"
+#include "rewind.h"
+#include "test.h"
+
+#define DEV_PAGE 0xd0
+#define SUB 0x0500 // address of the subroutine
+#define MAX_STATES 4096
+
+static byte dev_count = 0;
+static unsigned dev_writes = 0;
+
+// A different value on every read, which going back can not ask for again.
+static byte DevRead(void *, word)
+{
+    return dev_count++;
+}
+
+static void DevWrite(void *, word, byte)
+{
+    dev_writes++;
+}
+
+static const bus_device_t dev = {"counter", DevRead, DevWrite, NULL};
+
+static uint64_t state_cycles[MAX_STATES];
+static uint64_t state_hash[MAX_STATES];
+static unsigned nstates = 0;
+
+// FNV-1a of the whole CPU, memory included.
+static uint64_t Hash()
+{
+    const byte *p = (const byte *)cpu;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(cpu_6502); i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+static void Save()
+{
+    if (nstates < MAX_STATES)
+    {
+        state_cycles[nstates] = total_cycles;
+        state_hash[nstates++] = Hash();
+    }
+}
+
+// Saved state at the current cycle count matches the CPU.
+static bool Same()
+{
+    for (unsigned i = 0; i < nstates; i++)
+        if (state_cycles[i] == total_cycles)
+            return state_hash[i] == Hash();
+    return false;
+}
+
+// Run ncycles one at a time, saving the state at each instruction boundary.
+static void Run(unsigned ncycles)
+{
+    CPUStart();
+    word ip = cpu->instr_ptr;
+    for (unsigned c = 0; c < ncycles && cpu_running; c++)
+    {
+        CPURunBlock(1, NULL);
+        if (cpu->instr_ptr != ip)
+        {
+            ip = cpu->instr_ptr;
+            Save();
+        }
+    }
+    CPUCommand(CMD_PAUSE);
+    CPUDrain();
+}
+
+int main()
+{
+    cpu = (cpu_6502 *)calloc(1, sizeof(cpu_6502));
+    trap_detect = false;
+    // read the device into a table, write it back, and push through a call
+    static const byte code[] = {
+        0xad, 0x00, 0xd0, // LDA $D000
+        0x9d, 0x00, 0x02, // STA $0200,X
+        0xe8,             // INX
+        0x8d, 0x01, 0xd0, // STA $D001
+        0x20, 0x00, 0x05, // JSR $0500
+        0x4c, 0x00, 0x04, // JMP $0400
+    };
+    static const byte sub[] = {
+        0x48, // PHA
+        0x68, // PLA
+        0x60, // RTS
+    };
+    memcpy(&cpu->mem[0x400], code, sizeof(code));
+    memcpy(&cpu->mem[SUB], sub, sizeof(sub));
+    cpu->mem[V_RESET] = 0x00, cpu->mem[V_RESET + 1] = 0x04;
+    CHECK(CPUBusMap(DEV_PAGE, 1, BUS_DEVICE, &dev));
+    CHECK(CPURewindEnable(8));
+    CPUReset();
+    Save();
+
+    // every boundary back to the reset, device values and pushes undone
+    Run(3000);
+    CHECK(dev_writes > 50);
+    // paused within an instruction, the first step goes to its start
+    unsigned back = 0, steps = nstates - (total_cycles == state_cycles[nstates - 1]);
+    bool same = true;
+    while (CPUStepBack())
+    {
+        same = same && Same();
+        back++;
+    }
+    CHECK(same);
+    CHECK(back == steps);
+    CHECK(total_cycles == 0);
+
+    // a debugger write is undone by stepping back across it
+    nstates = 0;
+    Save();
+    Run(500);
+    byte old = cpu->mem[0x0210];
+    CPUCommand(CMD_WRITE_BLOCK, 0x020e, 4, memcpy(malloc(4), "\x11\x22\x33\x44", 4));
+    CPUDrain();
+    CHECK(cpu->mem[0x0210] == 0x33);
+    CHECK(CPUStepBack());
+    CHECK(cpu->mem[0x0210] == old);
+    CHECK(Same());
+
+    // Run Back stops at the last boundary at a break point
+    Run(500);
+    CPUBreakSet(SUB, true);
+    CHECK(CPURunBack());
+    CHECK(cpu->instr_ptr == SUB && bp_hit == SUB);
+    CHECK(Same());
+    CPUBreakClear();
+
+    // a small journal wraps and still restores its oldest boundary
+    CHECK(CPURewindEnable(1));
+    uint64_t entries = rewind_journal_msk + 1;
+    uint64_t instrs = 0, want = 3 * entries;
+    nstates = 0;
+    CPUStart();
+    while (instrs < 4 * entries)
+    {
+        uint64_t n = 0;
+        CPURunBlock(1, &n);
+        instrs += n;
+        // the journal keeps the last entries instructions, the mark at enable included
+        if (n && instrs == want + 1)
+            Save();
+    }
+    CPUCommand(CMD_PAUSE);
+    CPUDrain();
+    CHECK(RewindOldest() == state_cycles[0]);
+    CHECK(CPURunBack());
+    CHECK(total_cycles == state_cycles[0]);
+    CHECK(Same());
+    CHECK(!CPUStepBack());
+    return TestDone("rewind");
+}
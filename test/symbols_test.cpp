@@ -0,0 +1,79 @@
+// Loading symbols from ld65 debug, VICE label and assignment files, the
+// lookups by address and by name, and lines that must be skipped.
+
+#include "symbols.h"
+#include "test.h"
+
+int main()
+{
+    char fname[64];
+    static const char dbg[] =
+        "version\tmajor=2,minor=0\n"
+        "sym\tid=0,name=\"start\",addrsize=absolute,scope=0,def=1,ref=2,val=0x8000,type=lab\n"
+        "sym\tid=1,name=\"loop\",addrsize=absolute,scope=0,def=3,val=0x8002,type=lab\n"
+        "sym\tid=2,name=\"import\",addrsize=absolute,scope=0,def=4,type=imp\n"
+        "sym\tid=3,name=\"big\",addrsize=far,scope=0,def=5,val=0x12000,type=lab\n"
+        "sym\tid=4,name=\"broken,val=0x9000\n";
+    CHECK(SymbolsLoad(TestFile(fname, sizeof(fname), ".dbg", dbg, sizeof(dbg) - 1)) == 2);
+    unlink(fname);
+    static const char vice[] =
+        "al C:a000 .add\n"
+        "al 9000 .vector\n"
+        "al C:zzzz .bad\n"
+        "al C:c000\n";
+    CHECK(SymbolsLoad(TestFile(fname, sizeof(fname), ".lbl", vice, sizeof(vice) - 1)) == 2);
+    unlink(fname);
+    static const char assign[] =
+        "; comment\n"
+        "zp = $10\n"
+        "  io_base equ 0xd000\n"
+        "count=42\n"
+        "alias = $8000\n"
+        "nothing =\n"
+        "huge = $10000\n"
+        "= $1234\n";
+    CHECK(SymbolsLoad(TestFile(fname, sizeof(fname), ".sym", assign, sizeof(assign) - 1)) == 4);
+    unlink(fname);
+    CHECK(SymbolsLoad("/nonexistent/file.sym") == -1);
+    CHECK(sym_count == 8);
+
+    word addr;
+    CHECK(SymbolFind("start", &addr) && addr == 0x8000);
+    CHECK(SymbolFind("add", &addr) && addr == 0xa000);
+    CHECK(SymbolFind("io_base", &addr) && addr == 0xd000);
+    CHECK(SymbolFind("count", &addr) && addr == 42);
+    CHECK(!SymbolFind("import", &addr));
+    CHECK(!SymbolFind("bad", &addr));
+    CHECK(!SymbolFind("sta", &addr));
+
+    // the first name added wins at a shared address
+    CHECK(SymbolAt(0x8000) != NULL && strcmp(SymbolAt(0x8000), "start") == 0);
+    CHECK(SymbolAt(0x8001) == NULL);
+    unsigned offset;
+    const char *name = SymbolNear(0x8001, SYM_NEAR_MAX, &offset);
+    CHECK(name != NULL && strcmp(name, "start") == 0 && offset == 1);
+    name = SymbolNear(0x8002, SYM_NEAR_MAX, &offset);
+    CHECK(name != NULL && strcmp(name, "loop") == 0 && offset == 0);
+    CHECK(SymbolNear(0x0005, SYM_NEAR_MAX, &offset) == NULL);
+    CHECK(SymbolNear(0x9200, SYM_NEAR_MAX, &offset) == NULL);
+
+    // many symbols, added out of order, stay sorted both ways
+    unsigned gen = sym_gen;
+    SymbolsClear();
+    CHECK(sym_count == 0 && sym_gen != gen && SymbolAt(0x8000) == NULL);
+    for (unsigned i = 0; i < 5000; i++)
+    {
+        char buf[16];
+        int len = snprintf(buf, sizeof(buf), "s%u", i);
+        CHECK(SymbolAdd(buf, len, (i * 7919) & 0xffff));
+    }
+    bool ok = true;
+    for (unsigned i = 0; i < 5000; i++)
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "s%u", i);
+        ok = ok && SymbolFind(buf, &addr) && addr == ((i * 7919) & 0xffff);
+    }
+    CHECK(ok);
+    return TestDone("symbols");
+}
@@ -0,0 +1,49 @@
+// Checks shared by the unit tests in test/. Each test is its own program that
+// prints the checks that failed and exits non-zero if there were any, run
+// them all with make test.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static unsigned test_checks = 0; // checks run
+static unsigned test_failed = 0; // checks that failed
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        test_checks++;                                                      \
+        if (!(cond))                                                        \
+        {                                                                   \
+            test_failed++;                                                  \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        }                                                                   \
+    } while (0)
+
+// Print the result of the test named name, returns the exit status for main().
+static inline int TestDone(const char *name)
+{
+    printf("%s: %u of %u checks passed\n", name, test_checks - test_failed, test_checks);
+    return test_failed ? 1 : 0;
+}
+
+// Write len bytes of data to a new temporary file, returns its name in buf.
+// The test removes it with unlink() when done.
+static inline const char *TestFile(char *buf, size_t sz, const char *ext, const void *data, size_t len)
+{
+    snprintf(buf, sz, "/tmp/mos6502_testXXXXXX%s", ext);
+    int fd = mkstemps(buf, strlen(ext));
+    if (fd < 0 || write(fd, data, len) != (ssize_t)len)
+    {
+        perror("TestFile: ");
+        exit(1);
+    }
+    close(fd);
+    return buf;
+}
+
+#endif // TEST_H
@@ -0,0 +1,155 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+trace_entry_t *trace_ring = NULL;
+std::atomic<uint64_t> trace_pos(0);
+std::atomic<bool> trace_enabled(false);
+std::atomic<uint64_t> trace_first(0);
+
+volatile bool trace_file_active = false;
+std::atomic<uint64_t> trace_file_pos(0);
+volatile uint64_t trace_file_lost = 0;
+volatile uint64_t trace_file_count = 0;
+static volatile bool trace_file_quit = false; // ask the writer thread to exit
+static FILE *trace_fp = NULL;
+static char *trace_fbuf = NULL;
+static pthread_t trace_thread;
+
+// Write the entries recorded since the last call, returns the number written.
+static uint64_t TraceFileFlush()
+{
+    uint64_t end = trace_pos.load(std::memory_order_acquire);
+    uint64_t pos = trace_file_pos.load(std::memory_order_relaxed);
+    if (end < pos) // rewound, the undone entries are already in the file
+        pos = end;
+    if (end - pos > TRACE_RING_SZ)
+    {
+        trace_file_lost += end - pos - TRACE_RING_SZ;
+        pos = end - TRACE_RING_SZ;
+    }
+    uint64_t count = end - pos;
+    while (pos < end)
+    {
+        // contiguous run up to the end of the ring
+        uint64_t idx = pos & (TRACE_RING_SZ - 1);
+        uint64_t n = end - pos;
+        if (n > TRACE_RING_SZ - idx)
+            n = TRACE_RING_SZ - idx;
+        fwrite(&trace_ring[idx], sizeof(trace_entry_t), n, trace_fp);
+        pos += n;
+    }
+    trace_file_pos.store(pos, std::memory_order_release);
+    trace_file_count += count;
+    return count;
+}
+
+static void *TraceFileThread(void *id)
+{
+    while (!trace_file_quit)
+    {
+        if (TraceFileFlush() == 0)
+            usleep(TRACE_FILE_POLL_US);
+    }
+    TraceFileFlush();
+    return NULL;
+}
+
+bool TraceEnable(bool on)
+{
+    if (on && trace_ring == NULL)
+    {
+        // kept once allocated, the CPU thread may still be recording into it
+        trace_ring = (trace_entry_t *)calloc(TRACE_RING_SZ, sizeof(trace_entry_t));
+        if (trace_ring == NULL)
+        {
+            printf("Could not allocate the trace ring\n");
+            return false;
+        }
+    }
+    trace_enabled.store(on, std::memory_order_release);
+    return true;
+}
+
+bool TraceFileStart(const char *fname)
+{
+    if (trace_file_active)
+        return true;
+    if (!TraceEnable(true))
+        return false;
+    trace_fp = fopen(fname, "wb");
+    if (trace_fp == NULL)
+    {
+        printf("Could not open trace file %s\n", fname);
+        return false;
+    }
+    trace_fbuf = (char *)malloc(TRACE_FILE_BUF_SZ);
+    if (trace_fbuf != NULL)
+        setvbuf(trace_fp, trace_fbuf, _IOFBF, TRACE_FILE_BUF_SZ);
+    trace_file_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    strncpy(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_FILE_VERSION;
+    hdr.entry_sz = sizeof(trace_entry_t);
+    fwrite(&hdr, sizeof(hdr), 1, trace_fp);
+    trace_file_pos.store(trace_pos.load(std::memory_order_acquire), std::memory_order_release);
+    trace_file_lost = 0;
+    trace_file_count = 0;
+    trace_file_quit = false;
+    if (pthread_create(&trace_thread, NULL, TraceFileThread, NULL))
+    {
+        perror("TraceFileStart: pthread_create: ");
+        fclose(trace_fp);
+        free(trace_fbuf);
+        trace_fp = NULL;
+        trace_fbuf = NULL;
+        return false;
+    }
+    trace_file_active = true;
+    return true;
+}
+
+void TraceFileStop()
+{
+    if (!trace_file_active)
+        return;
+    trace_file_quit = true;
+    pthread_join(trace_thread, NULL);
+    trace_file_active = false;
+    fclose(trace_fp);
+    free(trace_fbuf);
+    trace_fp = NULL;
+    trace_fbuf = NULL;
+}
+
+void TraceClear()
+{
+    trace_first.store(trace_pos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void TraceTruncate(uint64_t cycles)
+{
+    uint64_t pos = trace_pos.load(std::memory_order_relaxed);
+    uint64_t first = TraceFirst(pos);
+    trace_first.store(first, std::memory_order_relaxed);
+    while (pos > first && TRACE_CYCLES(&trace_ring[(pos - 1) & (TRACE_RING_SZ - 1)]) > cycles)
+        pos--;
+    trace_pos.store(pos, std::memory_order_release);
+}
+
+void TraceFormat(const trace_entry_t *ent, char *buf, size_t sz)
+{
+    const opcode_info_t *op = &OPCODE_INFO[ent->opcode];
+    char ea[8] = "";
+    if (op->access & (OP_READ | OP_WRITE))
+        snprintf(ea, sizeof(ea), "$%04X", ent->ea);
+    char p[9] = "NV-BDIZC";
+    for (int i = 0; i < 8; i++)
+        if (!((ent->p >> (7 - i)) & 1))
+            p[i] = '.';
+    snprintf(buf, sz, "%12llu  %04X  %02X %s  %-5s  A:%02X X:%02X Y:%02X SP:%02X %s",
+             (unsigned long long)TRACE_CYCLES(ent), TRACE_PC(ent), ent->opcode, op->name, ea,
+             ent->a, ent->x, ent->y, ent->sp, p);
+}
@@ -0,0 +1,130 @@
+// Execution trace: a fixed-size ring with one entry per executed instruction,
+// holding the registers before it executed and its effective address. The ring
+// is allocated once by the first TraceEnable(), the GUI calls it at startup so
+// that recording is always on, the headless runner only for -t or -o. The
+// hot path writes into the ring and never allocates. The CPU thread writes an
+// entry and then publishes it with a release store of trace_pos; readers on
+// other threads load trace_pos with acquire, and copy entries with
+// TraceRead(), which tells whether the CPU thread reused the slot meanwhile.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "c_6502.h" // 6502 CPU emulation
+#include "opcodes.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <atomic>
+
+#define TRACE_RING_SZ (1 << 20) // entries in the ring, power of 2
+#define TRACE_SHIFT 16          // stamp holds cycles << 16 | pc
+#define TRACE_LINE_SZ 80        // buffer size for TraceFormat()
+
+#define TRACE_FILE_MAGIC "6502TRC"  // 8 bytes including the terminator
+#define TRACE_FILE_VERSION 1        // bump when trace_entry_t changes
+#define TRACE_FILE_BUF_SZ (1 << 22) // stdio buffer of the trace file
+#define TRACE_FILE_POLL_US 1000     // writer thread sleep when it has caught up
+
+typedef struct
+{
+    uint64_t stamp; // total_cycles at the instruction's first cycle << TRACE_SHIFT | pc
+    word ea;        // effective address, 0 if the instruction accesses no memory
+    byte opcode;
+    byte a, x, y, sp;
+    byte p; // NV-BDIZC
+} trace_entry_t;
+
+typedef struct
+{
+    char magic[8];     // TRACE_FILE_MAGIC
+    uint32_t version;  // TRACE_FILE_VERSION
+    uint32_t entry_sz; // sizeof(trace_entry_t), followed by the entries
+} trace_file_hdr_t;
+
+extern trace_entry_t *trace_ring;         // TRACE_RING_SZ entries, NULL until TraceEnable()
+extern std::atomic<uint64_t> trace_pos;   // entries written since startup
+extern std::atomic<bool> trace_enabled;   // record while running
+extern std::atomic<uint64_t> trace_first; // oldest entry not dropped by TraceClear() or TraceTruncate()
+
+extern volatile bool trace_file_active;      // a writer thread streams the trace to a file
+extern std::atomic<uint64_t> trace_file_pos; // next entry the writer thread will write
+extern volatile uint64_t trace_file_lost;    // entries overwritten before they were written
+extern volatile uint64_t trace_file_count;   // entries written to the file
+
+#define TRACE_CYCLES(ent) ((ent)->stamp >> TRACE_SHIFT)
+#define TRACE_PC(ent) ((word)((ent)->stamp & 0xffff))
+
+// Record the instruction at cpu->instr_ptr as entry pos, called on its first
+// cycle after cycles total cycles. Returns pos + 1, published in trace_pos.
+static inline uint64_t TraceRecord(const cpu_6502 *cpu, uint64_t cycles, uint64_t pos)
+{
+    trace_entry_t *ent = &trace_ring[pos & (TRACE_RING_SZ - 1)];
+    word pc = cpu->instr_ptr;
+    op_access_t acc;
+    ent->stamp = (cycles << TRACE_SHIFT) | pc;
+    ent->ea = op_access(cpu, pc, &acc) ? acc.addr : 0;
+    ent->opcode = cpu->mem[pc];
+    ent->a = cpu->a;
+    ent->x = cpu->x;
+    ent->y = cpu->y;
+    ent->sp = cpu->sp;
+    ent->p = (cpu->n << 7) | (cpu->v << 6) | (cpu->rsvd << 5) | (cpu->b << 4) | (cpu->d << 3) | (cpu->i << 2) | (cpu->z << 1) | cpu->c;
+    trace_pos.store(pos + 1, std::memory_order_release);
+    return pos + 1;
+}
+
+// Called before recording up to n entries while writing a file: wait until
+// the writer thread has made room for them in the ring, so that the file
+// misses no entry. The CPU runs no faster than the file is written then.
+static inline void TraceFileWait(uint64_t n)
+{
+    if (!trace_file_active || !trace_enabled.load(std::memory_order_relaxed))
+        return;
+    if (n > TRACE_RING_SZ)
+        n = TRACE_RING_SZ;
+    while (trace_file_active &&
+           trace_pos.load(std::memory_order_relaxed) + n - trace_file_pos.load(std::memory_order_acquire) > TRACE_RING_SZ)
+        usleep(TRACE_FILE_POLL_US / 10);
+}
+
+// Allocate the ring if needed and start recording, or stop. Returns false if
+// the ring could not be allocated.
+bool TraceEnable(bool on);
+
+// Stream the trace to fname from now on, on a writer thread.
+bool TraceFileStart(const char *fname);
+// Write the remaining entries, stop the writer thread and close the file.
+void TraceFileStop();
+
+// Oldest entry that can be read while trace_pos is end. The slot of the entry
+// before it is the next one the CPU thread writes.
+static inline uint64_t TraceFirst(uint64_t end)
+{
+    uint64_t first = end >= TRACE_RING_SZ ? end - TRACE_RING_SZ + 1 : 0;
+    uint64_t kept = trace_first.load(std::memory_order_relaxed);
+    return first > kept ? first : kept;
+}
+// Entry at pos, between TraceFirst(end) and end - 1, for the CPU thread or
+// while the CPU is stopped.
+static inline const trace_entry_t *TraceEntry(uint64_t pos)
+{
+    return &trace_ring[pos & (TRACE_RING_SZ - 1)];
+}
+// Copy the entry at pos to *out from another thread while the CPU runs.
+// Returns false if the CPU thread may have written its slot meanwhile.
+static inline bool TraceRead(uint64_t pos, trace_entry_t *out)
+{
+    *out = trace_ring[pos & (TRACE_RING_SZ - 1)];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t end = trace_pos.load(std::memory_order_relaxed);
+    return pos < end && pos >= TraceFirst(end);
+}
+// Drop all entries.
+void TraceClear();
+// Drop the entries of instructions started after cycles total cycles.
+void TraceTruncate(uint64_t cycles);
+// Format an entry as one line of text.
+void TraceFormat(const trace_entry_t *ent, char *buf, size_t sz);
+
+#endif // TRACE_H
@@ -0,0 +1,66 @@
+// Converts a binary trace written by the GUI or the headless runner to text,
+// one instruction per line.
+
+#include "trace.h" // execution trace
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define TRACE2TXT_CHUNK 65536 // entries read at once
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <trace file> [output file]\n", argv[0]);
+        return 1;
+    }
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL)
+    {
+        printf("Could not open trace file %s\n", argv[1]);
+        return 1;
+    }
+    trace_file_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || strncmp(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic)))
+    {
+        printf("%s is not a trace file\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+    if (hdr.version != TRACE_FILE_VERSION || hdr.entry_sz != sizeof(trace_entry_t))
+    {
+        printf("Trace file version %u with %u byte entries, expected version %u with %u byte entries\n", hdr.version, hdr.entry_sz, TRACE_FILE_VERSION, (unsigned)sizeof(trace_entry_t));
+        fclose(fp);
+        return 1;
+    }
+    FILE *out = stdout;
+    if (argc == 3 && (out = fopen(argv[2], "w")) == NULL)
+    {
+        printf("Could not open output file %s\n", argv[2]);
+        fclose(fp);
+        return 1;
+    }
+    trace_entry_t *buf = (trace_entry_t *)malloc(TRACE2TXT_CHUNK * sizeof(trace_entry_t));
+    if (buf == NULL)
+    {
+        perror("main: malloc: ");
+        exit(-1);
+    }
+    char line[TRACE_LINE_SZ];
+    size_t n;
+    while ((n = fread(buf, sizeof(trace_entry_t), TRACE2TXT_CHUNK, fp)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            TraceFormat(&buf[i], line, sizeof(line));
+            fputs(line, out);
+            fputc('\n', out);
+        }
+    }
+    free(buf);
+    fclose(fp);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}